@@ -38,6 +38,17 @@ void print_uint16_string(struct myvector *v){
         printf (" %u", ((uint16_t *)v->ptr)[i]);
 }
 
+static void append_codes(struct myvector *codes, unsigned int n, void* pt) {
+    /* appends to the caller's buffer, dropping the codes which don't fit in it
+       (a damaged or hostile file can produce more codes than the image size) */
+    if (codes->elements + n > codes->alloc_elements)
+        n = codes->alloc_elements - codes->elements;
+    if (n) {
+        memcpy((uint16_t *)codes->ptr + codes->elements, pt, n * codes->element_size);
+        codes->elements += n;
+    }
+}
+
 unsigned int LZWAlgorythm(unsigned int lzw_code_size, unsigned int len, unsigned char* bytes, unsigned int codes_len, uint16_t* lzw_codes_ptr) {
     uint16_t CLEAR = 1 << lzw_code_size;
     uint16_t EOI = CLEAR + 1;
@@ -72,7 +83,8 @@ unsigned int LZWAlgorythm(unsigned int lzw_code_size, unsigned int len, unsigned
         printf("%s", "s =");
         print_uint16_string(&s);
         printf("%s", "\n");         */
-        memcpy (&accumulator, bytes + ind, 3);
+        accumulator = 0;
+        memcpy (&accumulator, bytes + ind, (len - ind < 3 ? len - ind : 3));
         accumulator >>= offset;
         code = accumulator & mask;
         offset += csize;
@@ -90,7 +102,7 @@ unsigned int LZWAlgorythm(unsigned int lzw_code_size, unsigned int len, unsigned
             }
             else if (flag == FIRST) {
                 if (code < CLEAR)
-                    myv_append(&lzw_codes, 1, &code);
+                    append_codes(&lzw_codes, 1, &code);
                 else {
                     printf("%s", "Bad LZW code");
                     return 0;
@@ -108,16 +120,16 @@ unsigned int LZWAlgorythm(unsigned int lzw_code_size, unsigned int len, unsigned
         }
         else {
             if (flag == DEFERRED)
-                myv_append(&lzw_codes, lzw_table_ptr[code].elements, lzw_table_ptr[code].ptr);
+                append_codes(&lzw_codes, lzw_table_ptr[code].elements, lzw_table_ptr[code].ptr);
             else if (code < lzw_table.elements) {
-                myv_append(&lzw_codes, lzw_table_ptr[code].elements, lzw_table_ptr[code].ptr);
+                append_codes(&lzw_codes, lzw_table_ptr[code].elements, lzw_table_ptr[code].ptr);
                 myv_copy(&s, lzw_table_ptr + oldcode);
                 myv_append(&s, 1, (uint16_t *)lzw_table_ptr[code].ptr);
             }
             else {
                 myv_copy(&s, lzw_table_ptr + oldcode);
                 myv_append(&s, 1, (uint16_t *)lzw_table_ptr[oldcode].ptr);
-                myv_append(&lzw_codes, s.elements, s.ptr);
+                append_codes(&lzw_codes, s.elements, s.ptr);
             }
             lzw_table_ptr = (struct myvector *)myv_append(&lzw_table, 1, &myv_null);
             myv_init(lzw_table_ptr + lzw_table.elements - 1, 2, s.elements, true);
@@ -142,12 +154,81 @@ unsigned int LZWAlgorythm(unsigned int lzw_code_size, unsigned int len, unsigned
 }
 
 
-unsigned int fill_colors(unsigned char* color_table, unsigned int color_codes_size, uint16_t* color_codes, unsigned char* colors) {
-    unsigned char* pt = colors;
-    for (unsigned int i = 0; i < color_codes_size; i++) {
-        memcpy(pt, color_table + 3 * color_codes[i], 3);
-        pt += 3;
+static int first_sample(int pos, unsigned int shift) {
+    /* index of the first canvas pixel whose sample falls at or after pos */
+    return (pos <= 0 ? 0 : (pos + (1 << shift) - 1) >> shift);
+}
+
+static unsigned int interlaced_row(unsigned int row, unsigned int height) {
+    /* position in the data stream of the given image row, following the 4 passes of
+       GIF interlacing (rows 0, 8, 16 ...; 4, 12, 20 ...; 2, 6, 10 ...; 1, 3, 5 ...) */
+    unsigned int n = 0;
+    if (row % 8 == 0)
+        return row / 8;
+    n += (height + 7) / 8;
+    if (row % 8 == 4)
+        return n + row / 8;
+    n += (height + 3) / 8;
+    if (row % 4 == 2)
+        return n + row / 4;
+    n += (height + 1) / 4;
+    return n + row / 2;
+}
+
+/* the loop on a canvas row, repeated for every pixel size so that the store is
+   chosen once per row and not once per pixel */
+#define COMPOSITE_ROW(STORE)                                \
+    for (int x = x0; x < x1; x++, pt += bpp) {              \
+        uint16_t code = codes[(x << shift) - left];         \
+        if (code != transparent_index) {                    \
+            uint32_t value = lut[code & 0xFF];              \
+            STORE;                                          \
+        }                                                   \
+    }
+
+unsigned int composite_colors(uint32_t* lut, unsigned int bpp, uint16_t* color_codes, unsigned int width,
+                              unsigned int height, int transparent_index, unsigned char* canvas,
+                              unsigned int canvas_width, unsigned int canvas_height, unsigned int canvas_pitch,
+                              int left, int top, unsigned int shift, int interlaced) {
+    /* palette expansion and compositing in a single pass: each color code is looked up
+       and written straight to its place in the canvas. lut is a table of 256 packed
+       pixel values (built once for every color table; codes are masked to 8 bits,
+       so larger ones never read past it) and bpp the size in bytes of a
+       canvas pixel (1, 2, 3 or 4). canvas_pitch is the distance in bytes between two
+       canvas rows, so the canvas can be the pixel memory of a Surface (where rows may
+       be padded) and the pixels are written directly into the frame. left and top are relative to the canvas origin and
+       may be negative (when the canvas is cropped): codes which fall outside the canvas
+       are skipped without looking them up.
+       When shift > 0 the canvas is 1 / (2 ^ shift) of the original size and every canvas
+       pixel takes the code at its top left corner (nearest neighbour).
+       When interlaced is nonzero the rows of codes are in the interlaced order: each image
+       row is read from its place in the stream, so no reordering pass is needed */
+    int x0 = first_sample(left, shift), y0 = first_sample(top, shift);
+    int x1 = first_sample(left + (int)width, shift), y1 = first_sample(top + (int)height, shift);
+    if (x1 > (int)canvas_width)
+        x1 = canvas_width;
+    if (y1 > (int)canvas_height)
+        y1 = canvas_height;
+    for (int y = y0; y < y1; y++) {
+        unsigned int row = (y << shift) - top;
+        uint16_t* codes = color_codes + (interlaced ? interlaced_row(row, height) : row) * width;
+        unsigned char* pt = canvas + y * canvas_pitch + bpp * x0;
+        switch (bpp) {
+            case 1:
+                COMPOSITE_ROW(*pt = (uint8_t)value)
+                break;
+            case 2:
+                COMPOSITE_ROW(uint16_t v16 = (uint16_t)value; memcpy(pt, &v16, 2))
+                break;
+            case 3:
+                COMPOSITE_ROW(pt[0] = (uint8_t)value; pt[1] = (uint8_t)(value >> 8); pt[2] = (uint8_t)(value >> 16))
+                break;
+            case 4:
+                COMPOSITE_ROW(memcpy(pt, &value, 4))
+                break;
+            default:
+                return 0;
+        }
     }
     return 1;
 }
-
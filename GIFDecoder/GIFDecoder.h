@@ -8,4 +8,7 @@ void print_codes_table(struct myvector *table);
 void print_uint16_string(struct myvector *table);
 
 unsigned int LZWAlgorythm(unsigned int lzw_code_size, unsigned int len, unsigned char* bytes, unsigned int codes_len, uint16_t* lzw_codes_ptr);
-unsigned int fill_colors(unsigned char* color_table, unsigned int color_codes_size, uint16_t* color_codes, unsigned char* colors);
+unsigned int composite_colors(uint32_t* lut, unsigned int bpp, uint16_t* color_codes, unsigned int width,
+                              unsigned int height, int transparent_index, unsigned char* canvas,
+                              unsigned int canvas_width, unsigned int canvas_height, unsigned int canvas_pitch,
+                              int left, int top, unsigned int shift, int interlaced);
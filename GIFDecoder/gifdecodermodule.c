@@ -0,0 +1,95 @@
+/* The CPython extension module _gifdecoder (built by setup.py), which gives
+   animimage.py the functions of GIFDecoder.c without ctypes: they take any object
+   with the buffer protocol (bytes, bytearray, memoryview, ctypes arrays) without
+   copying it, check the buffer sizes, and release the GIL while they run */
+
+#define PY_SSIZE_T_CLEAN
+#include <Python.h>
+#include "myvector.h"
+#include "GIFDecoder.h"
+
+static PyObject* gifdecoder_lzw(PyObject* self, PyObject* args) {
+    /* lzw(code_size, data, codes): decodes the LZW compressed data into the writable
+       buffer codes (uint16 color codes, the extra ones are dropped) and returns True,
+       or False if the data are not valid */
+    unsigned int code_size, ok;
+    Py_buffer data, codes;
+
+    if (!PyArg_ParseTuple(args, "Iy*w*", &code_size, &data, &codes))
+        return NULL;
+    if (code_size < 1 || code_size > 11 || data.len > UINT_MAX || codes.len / 2 > UINT_MAX) {
+        PyBuffer_Release(&data);
+        PyBuffer_Release(&codes);
+        PyErr_SetString(PyExc_ValueError, "Invalid LZW parameters");
+        return NULL;
+    }
+    Py_BEGIN_ALLOW_THREADS
+    ok = LZWAlgorythm(code_size, (unsigned int)data.len, (unsigned char*)data.buf,
+                      (unsigned int)(codes.len / 2), (uint16_t*)codes.buf);
+    Py_END_ALLOW_THREADS
+    PyBuffer_Release(&data);
+    PyBuffer_Release(&codes);
+    return PyBool_FromLong(ok);
+}
+
+static PyObject* gifdecoder_composite(PyObject* self, PyObject* args) {
+    /* composite(lut, bpp, codes, width, height, transparent_index, canvas, canvas_width,
+       canvas_height, canvas_pitch, left, top, shift, interlaced): draws the color codes
+       of an image over the writable buffer canvas (see composite_colors()) */
+    Py_buffer lut, codes, canvas;
+    unsigned int bpp, width, height, canvas_width, canvas_height, canvas_pitch, shift, ok = 0;
+    int transparent_index, left, top, interlaced;
+    const char* error = NULL;
+
+    if (!PyArg_ParseTuple(args, "y*Iy*IIiw*IIIiiIi", &lut, &bpp, &codes, &width, &height,
+                          &transparent_index, &canvas, &canvas_width, &canvas_height,
+                          &canvas_pitch, &left, &top, &shift, &interlaced))
+        return NULL;
+    if (bpp < 1 || bpp > 4 || shift > 3 || canvas_pitch < (size_t)canvas_width * bpp)
+        error = "Invalid canvas format";
+    else if (lut.len < 256 * 4)
+        error = "Lookup table too short";
+    else if ((size_t)codes.len / 2 < (size_t)width * height)
+        error = "Color codes buffer too short";
+    else if (canvas_height && (size_t)canvas.len < (size_t)canvas_pitch * (canvas_height - 1) +
+                                                   (size_t)canvas_width * bpp)
+        error = "Canvas buffer too short";
+    if (!error) {
+        Py_BEGIN_ALLOW_THREADS
+        ok = composite_colors((uint32_t*)lut.buf, bpp, (uint16_t*)codes.buf, width, height,
+                              transparent_index, (unsigned char*)canvas.buf, canvas_width,
+                              canvas_height, canvas_pitch, left, top, shift, interlaced);
+        Py_END_ALLOW_THREADS
+    }
+    PyBuffer_Release(&lut);
+    PyBuffer_Release(&codes);
+    PyBuffer_Release(&canvas);
+    if (error) {
+        PyErr_SetString(PyExc_ValueError, error);
+        return NULL;
+    }
+    return PyBool_FromLong(ok);
+}
+
+static PyObject* gifdecoder_canvas(PyObject* self, PyObject* canvas) {
+    /* canvas(buffer): returns what composite() takes as canvas, i.e. the buffer itself
+       (the ctypes interface in animimage.py returns a pointer to it instead) */
+    Py_INCREF(canvas);
+    return canvas;
+}
+
+static PyMethodDef gifdecoder_methods[] = {
+    {"lzw", gifdecoder_lzw, METH_VARARGS, "Decode LZW compressed data into color codes."},
+    {"composite", gifdecoder_composite, METH_VARARGS, "Draw the color codes of an image over a canvas."},
+    {"canvas", gifdecoder_canvas, METH_O, "Return the object to give to composite() as canvas."},
+    {NULL, NULL, 0, NULL}
+};
+
+static struct PyModuleDef gifdecoder_module = {
+    PyModuleDef_HEAD_INIT, "_gifdecoder", "Native functions of the animimage GIFDecoder.", -1,
+    gifdecoder_methods
+};
+
+PyMODINIT_FUNC PyInit__gifdecoder(void) {
+    return PyModule_Create(&gifdecoder_module);
+}
@@ -91,12 +91,20 @@ class AnimSprite(pygame.sprite.Sprite):
         self.image = None
         ## The Sprite actual Rect.
         self.rect = None
+        self._offset = (0, 0)
+        _holders.add(self)
         
     def set_images(self, img_list, loop=False):
         """Set the list of the animation frames and start the animation.
         You must call this before using the object.
         \param img_list an iterable which can contain strings (they are interpreted
-        as filenames, and the method will try to load them) or Surface objects;
+        as filenames, and the method will try to load them) or Surface objects; it
+        can also be a FrameStore object (such as DeltaFrames or CompressedFrames),
+        which is used as is (with AtlasFrames the Sprite _rect_ is the one of the
+        trimmed frame, and it's moved by the frame offset when the frame changes).
+        DeltaFrames and CompressedFrames objects are copied (see FrameStore.copy()),
+        so many Sprites can show the same frames without changing each other's
+        working Surfaces;
         \param loop if **False** the Sprite will be killed (i.e\. deleted from all
         Group it belongs) after the last frame, otherwise the animation will restart
         from the first frame and you must kill or stop it by yourself.
@@ -104,15 +112,26 @@ class AnimSprite(pygame.sprite.Sprite):
         the 1st Surface, so all frames should have the same dimensions or you may get
         unexpected behaviour.
         """
-        for obj in img_list:
-            if isinstance(obj, str):
-                self.images.append(pygame.image.load(obj).convert_alpha())
-            elif isinstance(obj, pygame.Surface):
-                self.images.append(obj)
+        if isinstance(img_list, (DeltaFrames, CompressedFrames)):
+            # every Sprite needs its own working Surfaces
+            self.images = img_list.copy()
+        elif isinstance(img_list, FrameStore):
+            self.images = img_list
+        else:
+            if isinstance(self.images, FrameStore):
+                self.images = []
+            for obj in img_list:
+                if isinstance(obj, str):
+                    self.images.append(pygame.image.load(obj).convert_alpha())
+                elif isinstance(obj, pygame.Surface):
+                    self.images.append(obj)
         self.loop = loop
         self.rect = self.images[0].get_rect() if self.images else None
         self.frame = 0
-        self.image = self.images[0] if self.images else None
+        self._offset = (0, 0)
+        self.image = None
+        if self.images:
+            self._set_current_image()
         self._rate_offset = 0
         self.running = True
         if _debug:
@@ -131,7 +150,7 @@ class AnimSprite(pygame.sprite.Sprite):
             if frame >= len(self.images):
                 raise IndexError("List index out of range")
             self.frame = frame
-            self.image = self.images[self.frame]
+            self._set_current_image()
         if _debug:
             print("Frame", self.frame, "AnimSprite animation stopped")        
     
@@ -147,7 +166,7 @@ class AnimSprite(pygame.sprite.Sprite):
             if frame >= len(self.images):
                 raise IndexError("List index out of range")
             self.frame = frame
-            self.image = self.images[self.frame]
+            self._set_current_image()
         self.running = True
         self._rate_offset = 0
         if _debug:
@@ -185,7 +204,7 @@ class AnimSprite(pygame.sprite.Sprite):
                     self.frame = 0
                     if not self.loop:
                         self.kill()
-                self.image = self.images[self.frame]
+                self._set_current_image()
 
     def set_loop(loop):
         """Enable or disable the animation loop.
@@ -197,6 +216,16 @@ class AnimSprite(pygame.sprite.Sprite):
         """
         if loop in (True, False):
             self.loop = loop
+
+    def _set_current_image(self):
+        ## Internal function
+        self.image = self.images[self.frame]
+        if isinstance(self.images, AtlasFrames):
+            # trimmed frames are placed at their offset into the whole frame
+            x, y = self.images.get_offset(self.frame)
+            self.rect = pygame.Rect(self.rect.x - self._offset[0] + x, self.rect.y - self._offset[1] + y,
+                                    self.image.get_width(), self.image.get_height())
+            self._offset = (x, y)
             
             
 #######################################################################
@@ -234,6 +263,7 @@ class VanishSprite(pygame.sprite.Sprite):
         self.set_param()
         ## **True** if the animation is in process, **False** if it is stopped.
         self.running = False
+        _holders.add(self)
         
     def set_image(self, img):
         """Set the initial image of the animation and start the animation.
@@ -393,6 +423,7 @@ class FlashSprite(pygame.sprite.Sprite):
         self.set_param()
         ## **True** if the animation is in process, **False** if it is stopped.
         self.running = False
+        _holders.add(self)
         
     def set_image(self, img):
         """Set the initial image of the animation and start the animation. 
@@ -540,8 +571,14 @@ class FlashSprite(pygame.sprite.Sprite):
 #######################################################################
        
 
-import time, os
+import time, os, sys, hashlib, zlib
+from collections import OrderedDict
 from ctypes import *
+from array import array
+try:
+    import numpy as np
+except ImportError:
+    np = None
                 
 # codes for GIF blocks
 _IMAGE_SEPARATOR = 0x2C
@@ -565,13 +602,24 @@ _DISPOSALS = (
     "No disposal",
     "Restore to background color",
     "Restore to previous")
+# default for the maximum canvas size (pixels) accepted by the decoder
+_MAX_PIXELS = 2 ** 26
+# number of lookup tables kept in the cache (see _get_lut())
+_LUT_CACHE_SIZE = 64
+# maximum size (bytes) of the color codes kept in the cache (see _get_codes())
+_CODES_CACHE_BYTES = 2 ** 24
+# value of the native parameter of _get_lut() and _get_codes() for the numpy routines
+_NUMPY = "numpy"
 # String for version algorythm
 _LOG_STRING = """"Algorythm with output
-LZWAlgorythm and fill_colors in C called from Python
+LZWAlgorythm and composite_colors in C called from Python
                 
 """
                 
 _debug, _log = False, False
+_lut_cache = OrderedDict()
+_codes_cache = OrderedDict()
+_codes_cache_bytes = 0
 
 def set_debug(debug=None, log=None):
     if debug is not None:
@@ -580,11 +628,351 @@ def set_debug(debug=None, log=None):
         _log = log
 
 
+class _RGBFormat:
+    """Internal class describing the pixels of 24 bit RGB frames.
+    The decoder writes the pixel values given by values() into the canvas and
+    builds the frames from it with make_surface(). Subclasses implement the
+    other output modes."""
+    ## Size in bytes of a pixel.
+    bpp = 3
+    ## Key for the lookup tables cache, **None** if the pixel values depend on
+    # the file being decoded (so the tables can't be shared).
+    key = "RGB"
+    ## Colorkey of the frames (**None** for opaque frames).
+    colorkey = None
+    ## Masks of the pixels in the canvas.
+    masks = (0xFF, 0xFF00, 0xFF0000, 0)
+    ## Palette of the frames (**None** if they have no palette).
+    palette = None
+
+    def start(self, color_table, transparent):
+        """Called by the decoder before drawing the first image, with its color
+        table and transparent index (-1 if none). Return the pixel value to which
+        the canvas must be initialized."""
+        return 0
+
+    def pixel(self, color):
+        """Return the pixel value of a color (a bytes object with r, g, b)."""
+        return int.from_bytes(color, "little")
+
+    def values(self, color_table):
+        """Return the list of the pixel values of the colors of a color table."""
+        return [self.pixel(color_table[i:i + 3]) for i in range(0, len(color_table), 3)]
+
+    def to_bytes(self, value):
+        """Return a pixel value as stored into the canvas."""
+        return value.to_bytes(self.bpp, "little")
+
+    def make_surface(self, data, size, colorkey=True):
+        """Make a Surface of the given size from the canvas pixels in _data_.
+        If _colorkey_ is **False** the colorkey is not set."""
+        return pygame.image.frombytes(data, size, "RGB")
+
+    def canvas_surface(self, size):
+        """Return a Surface of the given size whose pixels have the same layout of
+        the canvas, so the decoder can draw directly into it."""
+        if self.bpp == 1:
+            return pygame.Surface(size, 0, 8)
+        return pygame.Surface(size, 0, 8 * self.bpp, self.masks)
+
+    def prepare(self, surf):
+        """Set the palette and the colorkey of a frame drawn into a Surface given
+        by canvas_surface()."""
+        if self.palette:
+            surf.set_palette(self.palette)
+        if self.colorkey is not None:
+            surf.set_colorkey(self.colorkey)
+
+
+class _PaletteFormat(_RGBFormat):
+    """Internal class describing the pixels of 8 bit palette indexed frames.
+    The color table of the first image is the palette of the frames, so its
+    color codes are written into the canvas as they are, and its transparent
+    index (if any) is the colorkey of the frames and the initial value of the
+    canvas. The colors of other color tables (and the color of the colorkey,
+    when other images don't use it as transparent) are mapped to the same
+    colors of the palette, or added to it if there is room, or approximated
+    with the nearest color."""
+    bpp = 1
+    key = None
+    masks = (0, 0, 0, 0)
+
+    def __init__(self):
+        ## The palette, a list of r, g, b tuples.
+        self.palette = []
+        self.colorkey = None
+        self.luts = {}
+        self._table = None
+        self._indexes = {}
+
+    def start(self, color_table, transparent):
+        self._table = color_table
+        self.palette = [tuple(color_table[i:i + 3]) for i in range(0, len(color_table), 3)]
+        self.colorkey = transparent if transparent >= 0 else None
+        for i in reversed(range(len(self.palette))):
+            if i != self.colorkey:
+                self._indexes[self.palette[i]] = i
+        return transparent if transparent >= 0 else 0
+
+    def pixel(self, color):
+        color = tuple(color)
+        index = self._indexes.get(color)
+        if index is None:
+            if len(self.palette) < 256:
+                index = len(self.palette)
+                self.palette.append(color)
+            else:
+                dist = lambda i: sum((a - b) ** 2 for a, b in zip(self.palette[i], color))
+                index = min((i for i in range(256) if i != self.colorkey), key=dist)
+            self._indexes[color] = index
+        return index
+
+    def values(self, color_table):
+        if color_table == self._table:
+            values = list(range(len(color_table) // 3))
+            if self.colorkey is not None:
+                values[self.colorkey] = self.pixel(color_table[3 * self.colorkey:3 * self.colorkey + 3])
+            return values
+        return super().values(color_table)
+
+    def make_surface(self, data, size, colorkey=True):
+        surf = pygame.image.frombytes(data, size, "P")
+        surf.set_palette(self.palette)
+        if colorkey and self.colorkey is not None:
+            surf.set_colorkey(self.colorkey)
+        return surf
+
+
+class _MaskFormat(_RGBFormat):
+    """Internal class describing the pixels of 16, 24 or 32 bit frames with any
+    masks (as the ones of the display Surface).
+    If the format has an alpha mask the pixels where nothing has been drawn are
+    transparent and the others opaque. Otherwise, if the first image has a
+    transparent index, the canvas starts filled with the colorkey (pure magenta),
+    and colors which would take its value are moved to the nearest one, so the
+    colorkey marks only the pixels where nothing has been drawn."""
+    def __init__(self, bitsize, masks):
+        if bitsize not in (16, 24, 32) or not all(masks[:3]):
+            raise ValueError("Unsupported pixel format")
+        self.bpp = bitsize // 8
+        self.masks = tuple(masks)
+        self.key = ("masks", bitsize, self.masks)
+        self._shifts = [(mask & -mask).bit_length() - 1 for mask in self.masks[:3]]
+        self._bits = [bin(mask).count("1") for mask in self.masks[:3]]
+        ## Pixel value of the colorkey.
+        self.key_value = self._pack(b"\xff\x00\xff")
+
+    def _pack(self, color):
+        ## INTERNAL FUNCTION
+        value = self.masks[3]
+        for c, mask, shift, bits in zip(color, self.masks, self._shifts, self._bits):
+            value |= (c >> max(0, 8 - bits)) << shift & mask
+        return value
+
+    def start(self, color_table, transparent):
+        if transparent < 0:
+            return self._pack(bytes(3))
+        if self.masks[3]:
+            return 0
+        self.colorkey = (255, 0, 255)
+        return self.key_value
+
+    def pixel(self, color):
+        value = self._pack(color)
+        if value == self.key_value and not self.masks[3]:
+            value ^= 1 << self._shifts[2]
+        return value
+
+    def to_bytes(self, value):
+        # the C library writes 16 and 32 bit pixels in the machine byte order, as
+        # pygame does, and 24 bit ones as little endian
+        return value.to_bytes(self.bpp, "little" if self.bpp == 3 else sys.byteorder)
+
+    def canvas_surface(self, size):
+        return pygame.Surface(size, pygame.SRCALPHA if self.masks[3] else 0, 8 * self.bpp, self.masks)
+
+    def make_surface(self, data, size, colorkey=True):
+        surf = self.canvas_surface(size)
+        buf, pitch, row = surf.get_buffer(), surf.get_pitch(), self.bpp * size[0]
+        if pitch == row:
+            buf.write(bytes(data), 0)
+        else:
+            for y in range(size[1]):
+                buf.write(bytes(data[y * row:(y + 1) * row]), y * pitch)
+        del buf
+        if colorkey and self.colorkey is not None:
+            surf.set_colorkey(self.colorkey)
+        return surf
+
+
+# output modes of the decoder
+_FORMATS = {"RGB": _RGBFormat, "P": _PaletteFormat,
+            "RGB565": lambda: _MaskFormat(16, (0xF800, 0x07E0, 0x001F, 0))}
+
+
+def _make_format(mode):
+    """Return the pixel format object for the _mode_ parameter of GIFDecoder.decode()."""
+    if isinstance(mode, pygame.Surface):
+        return _MaskFormat(mode.get_bitsize(), mode.get_masks())
+    if mode not in _FORMATS:
+        raise ValueError("Invalid mode")
+    return _FORMATS[mode]()
+
+
+def _get_lut(color_table, native, fmt):
+    """Return a lookup table which maps the 256 color codes of a color table
+    to packed pixels.
+    Tables are built only the first time a color table is met, and then kept in
+    a cache shared by all GIFDecoder objects, so frames (and files) with the same
+    color table don't need to build them again (if the pixel values depend on the
+    file being decoded they are kept only for it). Codes beyond the end of the
+    table are mapped to the value 0.
+    \param color_table the color table (a bytes object with 3 bytes per color).
+    \param native if **True** the table is a ctypes array of 32 bit values for the
+    C library, if _NUMPY a numpy array of bytes with shape (256, bytes per pixel),
+    otherwise a list of bytes objects (one pixel each).
+    \param fmt the pixel format (a _RGBFormat object).
+    """
+    key = (color_table, native, fmt.key)
+    cache = _lut_cache if fmt.key else fmt.luts
+    lut = cache.get(key)
+    if lut is None:
+        values = fmt.values(color_table)
+        values += [0] * (256 - len(values))
+        if native == _NUMPY:
+            lut = np.frombuffer(b"".join(fmt.to_bytes(value) for value in values),
+                                np.uint8).reshape(256, fmt.bpp)
+        elif native:
+            lut = (c_uint32 * 256)(*values)
+        else:
+            lut = [fmt.to_bytes(value) for value in values]
+        cache[key] = lut
+        if cache is _lut_cache and len(_lut_cache) > _LUT_CACHE_SIZE:
+            _lut_cache.popitem(last=False)
+    elif cache is _lut_cache:
+        _lut_cache.move_to_end(key)
+    return lut
+
+
+def _get_codes(data, code_size, length, native, decode):
+    """Return the color codes of an image, decoding its compressed data only if
+    the same data have not been decoded recently.
+    The codes are kept in a cache shared by all GIFDecoder objects (up to
+    _CODES_CACHE_BYTES bytes), so repeated frames (in a file or in files decoded
+    one after another) are usually byte identical compressed blocks and skip the
+    LZW algorythm. The returned codes must not be modified.
+    \param data the compressed data of the image.
+    \param code_size, length the LZW minimum code size and the number of pixels.
+    \param native **True** for a ctypes array of uint16 (for the C library),
+    _NUMPY for a numpy array, **False** for a bytearray.
+    \param decode a function which decodes the data and returns the codes.
+    """
+    global _codes_cache_bytes
+    key = (hashlib.blake2b(data, digest_size=16).digest(), code_size, length, native)
+    entry = _codes_cache.get(key)
+    if entry is not None:
+        _codes_cache.move_to_end(key)
+        return entry[0]
+    codes = decode()
+    # every entry keeps the size it was accounted with (the codes are 8 or 16 bit)
+    nbytes = 2 * length
+    if nbytes <= _CODES_CACHE_BYTES:
+        _codes_cache[key] = (codes, nbytes)
+        _codes_cache_bytes += nbytes
+        while _codes_cache_bytes > _CODES_CACHE_BYTES:
+            _codes_cache_bytes -= _codes_cache.popitem(last=False)[1][1]
+    return codes
+
+
+def _interlaced_row(row, height):
+    """Return the position in the data stream of the given row of an
+    interlaced image (rows are stored in 4 passes: 0, 8, 16 ...; 4, 12,
+    20 ...; 2, 6, 10 ...; 1, 3, 5 ...)."""
+    if row % 8 == 0:
+        return row // 8
+    n = (height + 7) // 8
+    if row % 8 == 4:
+        return n + row // 8
+    n += (height + 3) // 8
+    if row % 4 == 2:
+        return n + row // 4
+    n += (height + 1) // 4
+    return n + row // 2
+
+
+class _FrameHashes:
+    """Internal class which finds identical frames from a hash of their pixels,
+    so they can share the same Surface. The hash is a 128 bit BLAKE2b digest
+    (fast, and with no practical chance of collisions)."""
+    def __init__(self):
+        self._surfaces = {}
+
+    def get(self, data, make):
+        """Return the Surface already built for the pixels in _data_, or call
+        _make_ (a function with no arguments) to build a new one."""
+        digest = hashlib.blake2b(data, digest_size=16).digest()
+        surf = self._surfaces.get(digest)
+        if surf is None:
+            surf = self._surfaces[digest] = make()
+        return surf
+
+
+def _dedupe_ratio(images):
+    """Return the number of frames in a list of Surface divided by the number of
+    different Surface objects."""
+    if isinstance(images, list) and images:
+        return len(images) / len({id(surf) for surf in images})
+    return 1.0
+    
+
+class _CtypesLib:
+    """Internal class which calls the functions of the dynamic library %GIFDecoder
+    through ctypes, with the same interface of the _gifdecoder extension module."""
+    def __init__(self, dll):
+        self._dll = dll
+        dll.LZWAlgorythm.argtypes = (c_uint, c_uint, c_char_p, c_uint, POINTER(c_uint16))
+        dll.LZWAlgorythm.restype = c_uint
+        dll.composite_colors.argtypes = (POINTER(c_uint32), c_uint, POINTER(c_uint16), c_uint, c_uint,
+                                         c_int, POINTER(c_ubyte), c_uint, c_uint, c_uint, c_int,
+                                         c_int, c_uint, c_int)
+        dll.composite_colors.restype = c_uint
+
+    def lzw(self, code_size, data, codes):
+        if not isinstance(data, bytes):
+            # a writable buffer (as the bytearray of the image data) is used in place
+            data = (c_char * len(data)).from_buffer(data)
+        return self._dll.LZWAlgorythm(code_size, len(data), data, len(codes), codes)
+
+    def composite(self, *args):
+        return self._dll.composite_colors(*args)
+
+    @staticmethod
+    def canvas(canvas):
+        return (c_ubyte * len(canvas)).from_buffer(canvas)
+
+
+def _load_native():
+    """Return the object which gives the functions of the C code: the _gifdecoder
+    extension module if it's built, otherwise a _CtypesLib with the dynamic library,
+    or **None** if neither is found."""
+    try:
+        import _gifdecoder
+        return _gifdecoder
+    except ImportError:
+        pass
+    libpath = os.path.join(os.path.split(os.path.realpath(__file__))[0], "GIFDecoder",
+                           "GIFDecoder.dll" if os.name == "nt" else "GIFDecoder.so")
+    try:
+        return _CtypesLib(CDLL(libpath))
+    except OSError:
+        return None
+
+
 class GIFDecoderError(Exception):
     def __init__(self, message, image=None):
         if image:
             message = message + " decoding image " + str(image)
-        super.__init__(message)
+        super().__init__(message)
         
 
 class GIFDecoder:
@@ -597,23 +985,38 @@ class GIFDecoder:
     
     def __init__(self):
         """The constructor.
-        It tries to use the C dynamic library %GIFDecoder (.dll or .so)
-        for high speed decoding of the GIF files. If it doesn't find it
-        uses a slower Python routine."""
-        libpath = os.path.split(os.path.realpath(__file__))[0]
-        libpath = os.path.join(libpath, "GIFDecoder", "GIFDecoder.dll")
-        try:
-            self._lib = CDLL(libpath)
-        except FileNotFoundError:
-            self._lib = None
+        It tries to use the C code for high speed decoding of the GIF files:
+        first the _gifdecoder extension module (built with setup.py), then the
+        dynamic library %GIFDecoder (GIFDecoder.dll on Windows, GIFDecoder.so
+        on the other systems) in the GIFDecoder directory. If it doesn't find
+        them it uses a slower Python routine."""
+        self._lib = _load_native()
+        if self._lib is None:
             print("WARNING: C Library not found. Using (slower) Python implementation")
-        else:
-            self._lib.LZWAlgorythm.argtypes = (c_uint, c_uint, c_char_p, c_uint, POINTER(c_uint16))
-            self._lib.LZWAlgorythm.restype = c_uint
-            self._lib.fill_colors.argtypes = (c_char_p, c_uint, POINTER(c_uint16), POINTER(c_ubyte))
-            self._lib.fill_colors.restype = c_uint
         
+        self.set_limits()
         self.reset_all()
+        _holders.add(self)
+
+    def set_limits(self, max_pixels=_MAX_PIXELS, max_frames=None, max_bytes=None, max_ratio=None):
+        """Set the limits which a GIF file must respect to be decoded.
+        They are checked by the decode() method scanning the file structure before
+        allocating any memory for the images, so damaged or malicious files (for
+        example "decompression bombs") are rejected cheaply with a GIFDecoderError.
+        For every parameter **None** means no limit.
+        \param max_pixels the maximum number of pixels of the logical screen and of
+        every single image in the file.
+        \param max_frames the maximum number of images in the file.
+        \param max_bytes the maximum amount of memory (in bytes) taken by the returned
+        frames, counted as whole frames in the pixel format given to decode() (even
+        if _delta_, _compress_ or _dedupe_ make them take less).
+        \param max_ratio the maximum ratio between the number of pixels of an image
+        and the size in bytes of its compressed data.
+        """
+        self._max_pixels = max_pixels
+        self._max_frames = max_frames
+        self._max_bytes = max_bytes
+        self._max_ratio = max_ratio
         
     def reset_all(self):
         """Reset the class to its initial state.
@@ -632,6 +1035,27 @@ class GIFDecoder:
         self._back_index = 0
         self._aspect_ratio = 0
         self._images = []
+        self._frame_count = 0
+        self._keep = []
+        self._crop = pygame.Rect(0, 0, 0, 0)
+        self._shift = 0
+        self._canvas_width = 0
+        self._canvas_height = 0
+        self._canvas = None
+        self._canvas_ptr = None
+        self._pitch = 0
+        self._surface = None
+        self._surface_buffer = None
+        self._surface_owned = False
+        self._saved_canvas = None
+        self._last_disposal = 0
+        self._last_rect = (0, 0, 0, 0)
+        self._format = _RGBFormat()
+        self._delta = False
+        self._dirty = pygame.Rect(0, 0, 0, 0)
+        self._kept_canvas = None
+        self._hashes = None
+        self._delays = []
         self._reset_graphics()
         self._reset_image()
         
@@ -686,194 +1110,693 @@ class GIFDecoder:
             self._buffer += self._f.read(size)
             size = self._f.read(1)[0]
     
+    def _skip_blocks(self):
+        """Skip a series of data blocks and return the size of their content."""
+        size = self._f.read(1)
+        tot_size = 0
+        while size != bytes((_BLOCK_TERMINATOR,)):
+            if not size:
+                raise GIFDecoderError("Unexpected end of file")
+            tot_size += size[0]
+            self._f.seek(size[0], os.SEEK_CUR)
+            size = self._f.read(1)
+        return tot_size
+
+    def _scan_images(self):
+        """Scan the file from the current position without decoding anything
+        and return a list of duples (pixels, size of the compressed data) for all
+        its images. The file position is restored at the end."""
+        images = []
+        start = self._f.tell()
+        block = self._f.read(1)
+        while block and block[0] != _TRAILER:
+            if block[0] == _EXTENSION_INTRODUCER:
+                self._f.read(1)
+                self._skip_blocks()
+            elif block[0] == _IMAGE_SEPARATOR:
+                desc = self._f.read(9)
+                if len(desc) < 9:
+                    raise GIFDecoderError("Unexpected end of file")
+                pixels = int.from_bytes(desc[4:6], "little") * int.from_bytes(desc[6:8], "little")
+                if desc[8] & 0x80:
+                    self._f.seek(3 * 2 ** ((desc[8] & 0x07) + 1), os.SEEK_CUR)
+                code_size = self._f.read(1)
+                if not code_size or not 1 <= code_size[0] <= 8:
+                    raise GIFDecoderError("Bad LZW code size", image=len(images) + 1)
+                images.append((pixels, self._skip_blocks()))
+            else:
+                raise GIFDecoderError("Unknown block", image=len(images))
+            block = self._f.read(1)
+        self._f.seek(start)
+        return images
+
+    def _check_limits(self, images):
+        """Check the scanned images against the limits set by set_limits() and
+        throw a GIFDecoderError if one of them is exceeded."""
+        pixels = self._screen_width * self._screen_height
+        if self._max_pixels is not None and pixels > self._max_pixels:
+            raise GIFDecoderError("Logical screen too large ({} pixels)".format(pixels))
+        if self._max_frames is not None and len(images) > self._max_frames:
+            raise GIFDecoderError("Too many images ({})".format(len(images)))
+        frame_bytes = self._format.bpp * self._canvas_width * self._canvas_height
+        if self._max_bytes is not None and sum(self._keep) * frame_bytes > self._max_bytes:
+            raise GIFDecoderError("Decoded frames too large ({} bytes)".format(sum(self._keep) * frame_bytes))
+        for i, (pixels, data_size) in enumerate(images[:len(self._keep)]):
+            if self._max_pixels is not None and pixels > self._max_pixels:
+                raise GIFDecoderError("Image too large ({} pixels)".format(pixels), image=i + 1)
+            if self._max_ratio is not None and pixels > self._max_ratio * max(data_size, 1):
+                raise GIFDecoderError("Compression ratio too high", image=i + 1)
+
+    def _select_frames(self, count, frames, step):
+        """Set self._keep, a list of booleans telling which of the first
+        _count_ images must be returned by decode(). It is truncated after the
+        last one, so the images after it are not decoded at all."""
+        self._keep = []
+        selected = 0
+        for i in range(count):
+            keep = frames is None or i in frames
+            if keep:
+                keep = selected % step == 0
+                selected += 1
+            self._keep.append(keep)
+        while self._keep and not self._keep[-1]:
+            self._keep.pop()
+
     def _print_image_attr(self):
         """Print the attributes of the image being decoded."""
-        print("Image n.", len(self._images) + 1)
+        print("Image n.", self._frame_count)
         print("Topleft {:5} x{:5}    Dims {:5} x{:5}".
               format(self._image_left_pos, self._image_top_pos, self._image_width, self._image_height))
         print("Disposal method:   ", _DISPOSALS[self._disposal_method])
         print("Interlaced:", self._is_interlaced, " Local table:", self._has_local_table,
               " Transparent color:", self._transparent_index if self._has_transparent_color else "None")
             
-    def _LZWalgorythm(self, color_codes):
+    def _LZWalgorythm(self):
         """Implement the LZW algorythm to decodify an image data block.
-        The object uses this method only when it can't find the C dynamic library
-        GIFDecoder (.dll or .so).""" 
-        CLEAR = 2 ** self._lzw_code_size
+        The object uses this method only when it can't find the C code.
+        No string of the table is ever built: every string is the one of its prefix
+        code followed by one pixel, i.e. the pixels the decoder wrote when it met
+        the prefix code and the first one of the next string, so the table only
+        keeps where they are in the output (and how long they are), and every code
+        is a slice copy from there. Codes beyond the size of the image are
+        dropped, and missing ones left to 0.
+        \return the color codes, a bytearray with one code for every pixel of the
+        image.
+        """
+        code_size = self._lzw_code_size
+        if not 1 <= code_size <= 8:
+            raise GIFDecoderError("Bad LZW code size", image=self._frame_count)
+        CLEAR = 1 << code_size
         EOI = CLEAR + 1
-        lzw_table = [(i,) for i in range(2 ** self._lzw_code_size)]
-        lzw_table.extend((CLEAR, EOI))
-        csize = self._lzw_code_size + 1
-        mask = 2 ** csize - 1
+        max_codes = self._image_width * self._image_height
+        # room for the last string, which can go beyond the image
+        table_size = 1 << _MAX_CSIZE
+        size = max_codes + table_size
+        codes = bytearray(size)
+        out = memoryview(codes)
+        # where the string of every code starts in the output, and its length
+        start = array("L", [0]) * table_size
+        length = array("H", [0]) * table_size
+        data = self._buffer
+        next_code = EOI + 1
+        csize = code_size + 1
+        mask = (1 << csize) - 1
         flag = _MUSTCLEAR
-        code = oldcode = None
-        
-        offset = 0
-        ind = 0
-        while ind < len(self._buffer):
-            accumulator = int.from_bytes(self._buffer[ind:ind + 3], "little")
-            accumulator >>= offset
+        old_pos = old_len = 0
+        accumulator = bits = ind = pos = 0
+
+        while pos < max_codes:
+            if bits < csize:
+                # refill the bit accumulator, some bytes at a time
+                chunk = data[ind:ind + 6]
+                if chunk:
+                    accumulator |= int.from_bytes(chunk, "little") << bits
+                    bits += len(chunk) << 3
+                    ind += 6
+                elif bits <= 0:
+                    break
+                # else the last code is padded with 0 bits
             code = accumulator & mask
-            offset += csize
-            while offset >= 8:
-                offset -= 8
-                ind += 1
-                
-            if flag not in (_NORMAL, _DEFERRED):
-                if flag == _MUSTCLEAR:
-                    if code != CLEAR:
-                        raise GIFDecoderError("Bad LZW code", image=len(self._images)+1)
-                    flag = _FIRST
-                elif flag == _FIRST:
-                    if code < CLEAR:
-                        color_codes.extend(lzw_table[code])
-                    else:
-                        raise GIFDecoderError("Bad LZW code", image=len(self._images)+1)
-                    flag = _NORMAL
-            elif code == EOI:
-                break
+            accumulator >>= csize
+            bits -= csize
+
+            if flag == _MUSTCLEAR and code != CLEAR:
+                raise GIFDecoderError("Bad LZW code", image=self._frame_count)
+            if code < CLEAR:
+                # a single pixel
+                codes[pos] = code
+                n = 1
             elif code == CLEAR:
-                lzw_table = lzw_table[:2 ** self._lzw_code_size + 2]
-                csize = self._lzw_code_size + 1
-                mask = 2 ** csize - 1
+                next_code = EOI + 1
+                csize = code_size + 1
+                mask = (1 << csize) - 1
                 flag = _FIRST
-                code = None         # sets oldcode in the last instruction
+                continue
+            elif code == EOI:
+                break
+            elif code < next_code:
+                n = length[code]
+                s = start[code]
+                out[pos:pos + n] = out[s:s + n]
+            elif code == next_code and flag == _NORMAL:
+                # the string of the previous code followed by its first pixel
+                n = old_len + 1
+                out[pos:pos + old_len] = out[old_pos:old_pos + old_len]
+                codes[pos + old_len] = codes[old_pos]
             else:
-                if flag == _DEFERRED:
-                    color_codes.extend(lzw_table[code]) 
-                    continue
-                elif code < len(lzw_table):
-                    color_codes.extend(lzw_table[code])
-                    s = lzw_table[oldcode] + (lzw_table[code][0],)
-                else:
-                    s = lzw_table[oldcode] + (lzw_table[oldcode][0],)
-                    color_codes.extend(s)
-                lzw_table.append(s)
-                if len(lzw_table) == 2 ** csize:
+                raise GIFDecoderError("Bad LZW code", image=self._frame_count)
+
+            if flag == _NORMAL:
+                # the previous string followed by the first pixel of this one
+                start[next_code] = old_pos
+                length[next_code] = old_len + 1
+                next_code += 1
+                if next_code == 1 << csize:
                     if csize < _MAX_CSIZE:
                         csize += 1
-                        mask = 2 ** csize - 1
+                        mask = (1 << csize) - 1
                     else:
-                        flag = _DEFERRED        
-            oldcode = code
+                        flag = _DEFERRED
+            elif flag == _FIRST:
+                flag = _NORMAL
+            old_pos = pos
+            old_len = n
+            pos += n
+        out.release()
+        del codes[max_codes:]
+        return codes
         
     
-    def decode(self, fname):
+    def _read_image_descriptor(self):
+        """Read the image descriptor, the local color table (if any) and the
+        image data blocks (which are put into self._buffer)."""
+        self._reset_image()
+        self._image_left_pos = int.from_bytes(self._f.read(2), "little")
+        self._image_top_pos = int.from_bytes(self._f.read(2), "little")
+        self._image_width = int.from_bytes(self._f.read(2), "little")
+        self._image_height = int.from_bytes(self._f.read(2), "little")
+        self._buffer = self._f.read(1)
+        self._has_local_table = bool(self._buffer[0] & 0x80)
+        self._is_interlaced = bool(self._buffer[0] & 0x40)
+        if self._has_local_table:
+            self._is_local_sorted = bool(self._buffer[0] & 0x20)
+            self._local_table_size = 2 ** ((self._buffer[0] & 0x07) + 1)
+            self._local_color_table = bytes(self._f.read(3 * self._local_table_size))
+        self._lzw_code_size = self._f.read(1)[0]
+        if not 1 <= self._lzw_code_size <= 8:
+            raise GIFDecoderError("Bad LZW code size", image=self._frame_count)
+        self._read_blocks()
+
+    def _decode_image(self):
+        """Decode the image data in self._buffer and draw it over the canvas.
+        Data already decoded recently are not decoded again (see _get_codes()).
+        The color codes are looked up in the color table and written straight
+        into the canvas (skipping the transparent ones), so no intermediate
+        Surface is created."""
+        if self._has_local_table:
+            color_table = self._local_color_table
+        elif self._has_global_table:
+            color_table = self._global_color_table
+        else:
+            raise GIFDecoderError("No color table", image=self._frame_count)
+        transparent = self._transparent_index if self._has_transparent_color else -1
+        color_codes_len = self._image_width * self._image_height
+        # use the C dynamic library via ctypes
+        if self._lib:
+            def decode():
+                color_codes = (c_uint16 * color_codes_len)()
+                if not self._lib.lzw(self._lzw_code_size, self._buffer, color_codes):
+                    raise GIFDecoderError("LZW algorythm failed", image=self._frame_count)
+                return color_codes
+            color_codes = _get_codes(self._buffer, self._lzw_code_size, color_codes_len, True, decode)
+            self._lib.composite(_get_lut(color_table, True, self._format), self._format.bpp,
+                                color_codes, self._image_width, self._image_height, transparent,
+                                self._canvas_ptr, self._canvas_width, self._canvas_height,
+                                self._pitch, self._image_left_pos - self._crop.x,
+                                self._image_top_pos - self._crop.y, self._shift,
+                                self._is_interlaced)
+        # use the Python method (with numpy, if it's installed, for the compositing)
+        else:
+            native = _NUMPY if np else False
+            def decode():
+                try:
+                    color_codes = self._LZWalgorythm()
+                except GIFDecoderError:
+                    raise GIFDecoderError("LZW algorythm failed", image=self._frame_count)
+                if native:
+                    return np.frombuffer(color_codes, np.uint8)
+                return color_codes
+            color_codes = _get_codes(self._buffer, self._lzw_code_size, color_codes_len, native, decode)
+            lut = _get_lut(color_table, native, self._format)
+            if native:
+                self._composite_array(lut, color_codes, transparent)
+            else:
+                self._composite_colors(lut, color_codes, transparent)
+
+    def _composite_colors(self, lut, color_codes, transparent):
+        """Python equivalent of the C function composite_colors(), used
+        when the object can't find the C dynamic library."""
+        width, sh, bpp = self._image_width, self._shift, self._format.bpp
+        left = self._image_left_pos - self._crop.x
+        top = self._image_top_pos - self._crop.y
+        x0, x1 = self._canvas_span(left, width, self._canvas_width)
+        y0, y1 = self._canvas_span(top, self._image_height, self._canvas_height)
+        if x1 <= x0:
+            return
+        for y in range(y0, y1):
+            pos = y * self._pitch + bpp * x0
+            row = (y << sh) - top
+            if self._is_interlaced:
+                row = _interlaced_row(row, self._image_height)
+            start = row * width - left
+            for code in color_codes[start + (x0 << sh):start + (x1 << sh):1 << sh]:
+                if code != transparent:
+                    self._canvas[pos:pos + bpp] = lut[code]
+                pos += bpp
+
+    def _composite_array(self, lut, color_codes, transparent):
+        """numpy equivalent of the C function composite_colors(), used when the
+        object can't find the C code and numpy is installed: the codes of the
+        image are sampled with slicing, expanded with a single lookup into the
+        table and copied into the canvas with a mask of the transparent ones."""
+        width, height, sh, bpp = self._image_width, self._image_height, self._shift, self._format.bpp
+        left = self._image_left_pos - self._crop.x
+        top = self._image_top_pos - self._crop.y
+        x0, x1 = self._canvas_span(left, width, self._canvas_width)
+        y0, y1 = self._canvas_span(top, height, self._canvas_height)
+        if x1 <= x0 or y1 <= y0:
+            return
+        codes = color_codes.reshape(height, width)
+        if self._is_interlaced:
+            # the image row of every row of the stream, in the 4 passes order
+            rows = np.concatenate((np.arange(0, height, 8), np.arange(4, height, 8),
+                                   np.arange(2, height, 4), np.arange(1, height, 2)))
+            codes = np.empty_like(codes)
+            codes[rows] = color_codes.reshape(height, width)
+        step = 1 << sh
+        codes = codes[(y0 << sh) - top:((y1 - 1) << sh) - top + 1:step,
+                      (x0 << sh) - left:((x1 - 1) << sh) - left + 1:step]
+        canvas = np.frombuffer(self._canvas, np.uint8, self._pitch * self._canvas_height)
+        canvas = canvas.reshape(self._canvas_height, self._pitch)[y0:y1, bpp * x0:bpp * x1]
+        canvas = canvas.reshape(y1 - y0, x1 - x0, bpp)
+        if 0 <= transparent:
+            visible = codes != transparent
+            canvas[visible] = lut[codes[visible]]
+        else:
+            np.take(lut, codes, axis=0, out=canvas)
+
+    def _canvas_span(self, pos, size, limit):
+        """Return the first and last + 1 canvas pixels which take their samples
+        from the span pos ... pos + size - 1 of the original image (pos is
+        relative to the crop origin)."""
+        first = lambda p: 0 if p <= 0 else (p + (1 << self._shift) - 1) >> self._shift
+        return first(pos), min(first(pos + size), limit)
+
+    def _canvas_rect(self, left, top, width, height):
+        """Return the Rect of the canvas pixels which take their samples from the
+        given rectangle of the logical screen."""
+        x0, x1 = self._canvas_span(left - self._crop.x, width, self._canvas_width)
+        y0, y1 = self._canvas_span(top - self._crop.y, height, self._canvas_height)
+        return pygame.Rect(x0, y0, max(0, x1 - x0), max(0, y1 - y0))
+
+    def _add_dirty(self, rect):
+        """Add a Rect of the canvas to the area changed since the last returned
+        frame (only used in delta mode)."""
+        if rect:
+            self._dirty = self._dirty.union(rect) if self._dirty else rect
+
+    def _start_canvas(self):
+        """Initialize the canvas before drawing the first image."""
+        color_table = self._local_color_table if self._has_local_table else self._global_color_table
+        value = self._format.start(color_table, self._transparent_index if self._has_transparent_color else -1)
+        if value:
+            row = self._format.to_bytes(value) * self._canvas_width
+            self._canvas[:] = (row + bytes(self._pitch - len(row))) * self._canvas_height
+
+    def _dispose(self):
+        """Apply the disposal method of the last drawn image to the canvas.
+        This must be done before drawing the next image."""
+        if self._last_disposal == 2:
+            rect = self._canvas_rect(*self._last_rect)
+            back = self._global_color_table[3 * self._back_index:3 * self._back_index + 3]
+            row = self._format.to_bytes(self._format.pixel(back or bytes(3))) * rect.w
+            for y in range(rect.top, rect.bottom):
+                pos = y * self._pitch + self._format.bpp * rect.x
+                self._canvas[pos:pos + len(row)] = row
+            self._add_dirty(rect)
+        elif self._last_disposal == 3 and self._saved_canvas is not None:
+            self._canvas[:] = self._saved_canvas
+            self._add_dirty(self._canvas_rect(*self._last_rect))
+        self._saved_canvas = None
+
+    def _tighten_dirty(self):
+        """Shrink the changed area to the bounding box of the pixels which really
+        differ from the last returned frame (only used in delta mode)."""
+        rect, pitch, bpp = self._dirty, self._pitch, self._format.bpp
+        cur, prev = memoryview(self._canvas), memoryview(self._kept_canvas)
+        first = lambda a, b: next(i for i in range(len(a)) if a[i] != b[i]) // bpp
+        top = bottom = None
+        left, right = rect.right, rect.left
+        for y in range(rect.top, rect.bottom):
+            start = y * pitch
+            row = slice(start + bpp * rect.left, start + bpp * rect.right)
+            if cur[row] == prev[row]:
+                continue
+            if top is None:
+                top = y
+            bottom = y + 1
+            # only the pixels outside the box found so far need to be checked
+            row = slice(start + bpp * rect.left, start + bpp * left)
+            if cur[row] != prev[row]:
+                left = rect.left + first(cur[row], prev[row])
+            row = slice(start + bpp * max(right, left), start + bpp * rect.right)
+            if cur[row] != prev[row]:
+                right = rect.right - first(cur[row][::-1], prev[row][::-1])
+        if top is None:
+            self._dirty = pygame.Rect(0, 0, 0, 0)
+        else:
+            self._dirty = pygame.Rect(left, top, right - left, bottom - top)
+
+    def _canvas_region(self, rect):
+        """Return the pixels of a Rect of the canvas as a bytes object."""
+        bpp = self._format.bpp
+        if rect.size == (self._canvas_width, self._canvas_height) and self._pitch == bpp * rect.w:
+            return bytes(self._canvas)
+        return b"".join(self._canvas[y * self._pitch + bpp * rect.x:y * self._pitch + bpp * rect.right]
+                        for y in range(rect.top, rect.bottom))
+
+    def decode(self, fname, frames=None, step=1, crop=None, shrink=1, delta=False, mode="RGB",
+               dedupe=False, compress=False, contiguous=False, prepare=False):
         """Decode a GIF file and return its frames as a list of pygame Surface.
         You can get the list of images of the last decoded file also with the
         get_images() method.
         This can throw various GIFDecoderError if the decoding process fails for
         some cause.
-        \param fname the name of the GIF file to be slicen 
+        \param fname the name of the GIF file to be slicen
+        \param frames if you leave **None** all the frames of the file are returned,
+        otherwise you can give a range (or another iterable) with the indexes of the
+        frames you want.
+        \param step return only a frame every _step_ of the selected ones (i.e\. with
+        2 you get the 1st, 3rd, 5th ... of them).
+        \note frames which are not returned are still decoded, because next frames
+        may be drawn over them, but they are not converted into Surface objects. The
+        decoding stops after the last requested frame.
+        \param crop if you leave **None** you get the whole frames, otherwise you can
+        give a pygame Rect (or a tuple x, y, w, h) and get only this part of them. The
+        pixels outside it are discarded during the decoding and never stored.
+        \param shrink you can give 2, 4 or 8 to get frames reduced to 1/2, 1/4 or 1/8 of
+        their size (after cropping). Each pixel takes the color of the top left pixel
+        of the original square it replaces, and full size frames are never built.
+        \param delta if you leave **False** every frame is stored as a whole Surface,
+        otherwise the method returns a DeltaFrames object, which stores only the
+        part of every frame changed since the previous one. This takes much less
+        memory when only a small part of the image is animated.
+        \note a DeltaFrames object rebuilds every frame into the same working
+        Surface, so it must not be shared between Sprites: AnimSprite.set_images()
+        makes its own copy, and elsewhere you should use FrameStore.copy().
+        \param mode the format of the returned frames: "RGB" for 24 bit Surfaces,
+        "P" for 8 bit Surfaces with a palette (which take 1/3 of the memory and
+        are built directly from the color codes). In "P" mode the color table of
+        the first image is the palette and its transparent index is the colorkey
+        of the Surfaces (and the color of the pixels where nothing has been drawn).
+        If the file has other color tables their colors are added to the palette,
+        and if they don't fit they are approximated with the nearest color.
+        "RGB565" gives 16 bit Surfaces (half the memory of "RGB", and no conversion
+        when blitted to a 16 bit display); if the first image has a transparent
+        color they have the colorkey (255, 0, 255), set on the pixels where nothing
+        has been drawn.
+        You can also give a 16, 24 or 32 bit Surface, and get frames with its pixel
+        format, which are blitted to Surfaces of the same format without any
+        conversion. Give the display Surface (pygame.display.get_surface()) to get
+        frames with a colorkey as above, or a Surface with per pixel alpha of the
+        display format (as one returned by convert_alpha()) to get frames where the
+        pixels where nothing has been drawn are transparent.
+        \param dedupe if **True** identical frames (as idle loops or frames repeated
+        instead of using a longer delay) share the same Surface object, so the
+        memory taken scales with the number of different frames. See
+        get_dedupe_ratio(). This has no effect in delta mode, where unchanged
+        frames take no memory anyway, and with _compress_. It can't be used
+        together with _contiguous_, which gives every frame its place in the buffer.
+        \param compress if **True** the method returns a CompressedFrames object,
+        which keeps the frames compressed and expands them only when they are
+        shown. It can't be used together with _delta_, and it must not be shared
+        between Sprites either (see the note above).
+        \param contiguous if **True** the method returns a FrameBuffer object,
+        which keeps all the frames in a single buffer usable with numpy. It can't
+        be used together with _delta_, _compress_ and _dedupe_.
+        \param prepare if **True** the frames are converted for the fastest blitting
+        to the display with prepare_frames() (the display mode must be set). This
+        has no effect with _delta_, _compress_ and _contiguous_.
+        \note if the module anim_cache is enabled and the file was already decoded
+        with the same parameters the frames are taken from it (see AnimCache).
+        """
+        if frames is not None and not isinstance(frames, range):
+            # an iterator can be read only once
+            frames = frozenset(frames)
+        params = (frames if frames is None or isinstance(frames, range) else tuple(sorted(frames)),
+                  step, crop if crop is None else tuple(crop), shrink, delta,
+                  mode if isinstance(mode, str) else (mode.get_bitsize(), mode.get_masks()),
+                  dedupe, compress, contiguous)
+        item = anim_cache._lookup("GIF", fname, params)
+        if item:
+            self._end_decoding()
+            self.reset_all()
+            self._fname = fname
+            self._images, self._delays = item
+        else:
+            self.decode_start(fname, frames, step, crop, shrink, delta, mode, dedupe, compress, contiguous)
+            self.decode_resume()
+            self._images = anim_cache._store("GIF", fname, params, self._images, self._delays)
+        if prepare:
+            self._images = prepare_frames(self._images)
+        return self._images
+
+    def decode_start(self, fname, frames=None, step=1, crop=None, shrink=1, delta=False, mode="RGB",
+                     dedupe=False, compress=False, contiguous=False):
+        """Start decoding a GIF file without decoding any image.
+        The decoding then goes on calling decode_resume(), so a large file can be
+        decoded in small slices (for example one for every frame of a game) without
+        blocking the program. The parameters are the same of decode(). The file
+        header is read and checked here, so this can throw a GIFDecoderError too.
+        \note the object can decode only one file at once: use more GIFDecoder
+        objects if you want to decode many files at the same time.
         """
+        if step < 1:
+            raise ValueError("step must be a positive integer")
+        if shrink not in (1, 2, 4, 8):
+            raise ValueError("shrink must be 1, 2, 4 or 8")
+        fmt = _make_format(mode)
+        if delta + compress + contiguous > 1:
+            raise ValueError("Only one of delta, compress and contiguous can be used")
+        if dedupe and contiguous:
+            raise ValueError("dedupe can't be used with contiguous")
+        if frames is not None and not isinstance(frames, range):
+            frames = frozenset(frames)
+        self._end_decoding()
         if _log:
             self._log_start()
         if _debug:
             print ("Start decoding", fname)
         self._fname = fname
         self.reset_all()
-        with open(fname, "r+b") as self._f:
+        self._format = fmt
+        self._f = open(fname, "rb")
+        try:
             self._read_header()
             if self._has_global_table:
                 self._global_color_table = bytes(self._f.read(3 * self._global_table_size))
-            screen = pygame.Surface((self._screen_width, self._screen_height))
-            self._buffer = self._f.read(1)
-            while self._buffer[0] != _TRAILER:
-                if self._buffer[0] == _EXTENSION_INTRODUCER:
-                    self._buffer = self._f.read(1)
-                    if self._buffer[0] == _GRAPHIC_CONTROL_EXTENSION:
-                        if _debug:
-                            print("Graphic control extension")
-                        self._read_blocks()
-                        self._disposal_method = (self._buffer[0] & 0x1C) >> 2
-                        self._user_input = bool(self._buffer[0] & 0x02)
-                        self._has_transparent_color = bool(self._buffer[0] & 0x01)
-                        self._delay_time = int.from_bytes(self._buffer[1:3], "little")
-                        self._transparent_index = self._buffer[3]    
-                    elif self._buffer[0] == _COMMENT_EXTENSION:
-                        self._read_blocks()
-                        if _debug:
-                            print("Comment extension")
-                            print(self._buffer.decode("utf-8"))
-                    elif self._buffer[0] == _PLAIN_TEXT_EXTENSION:
-                        self._read_blocks()
-                        if _debug:
-                            print("Plain text extension")
-                            print(self._buffer.decode("utf-8"))
-                    elif self._buffer[0] == _APPLICATION_EXTENSION:
-                        self._read_blocks()
-                        if _debug:
-                            print("Application extension")
-                            print(self._buffer.decode("utf-8"))
-                    else:
-                        raise ValueError("Unknown extension")
-                elif self._buffer[0] == _IMAGE_SEPARATOR:
-                    if _debug:
-                        print("Image n.", len(self._images) + 1)
-                    self._reset_image()
-                    self._image_left_pos = int.from_bytes(self._f.read(2), "little")
-                    self._image_top_pos = int.from_bytes(self._f.read(2), "little")
-                    self._image_width = int.from_bytes(self._f.read(2), "little")
-                    self._image_height = int.from_bytes(self._f.read(2), "little")
-                    self._buffer = self._f.read(1)
-                    self._has_local_table = bool(self._buffer[0] & 0x80)
-                    self._is_interlaced = bool(self._buffer[0] & 0x40)
-                    if self._has_local_table:
-                        self._is_local_sorted = bool(self._buffer[0] & 0x20)
-                        self._local_table_size = 2 ** ((self._buffer[0] & 0x07) + 1)
-                        self._local_color_table = bytes(self._f.read(3 * self._local_table_size))
-                    self._lzw_code_size = self._f.read(1)[0]
-                    self._read_blocks()
-                    color_codes_len = self._image_width * self._image_height
-                    # use the C dynamic library via ctypes
-                    if self._lib:
-                        color_codes = (c_uint16 * color_codes_len)()
-                        if not self._lib.LZWAlgorythm(c_uint(self._lzw_code_size),
-                                                      c_uint(len(self._buffer)),
-                                                      c_char_p(bytes(self._buffer)),
-                                                      c_uint(color_codes_len),
-                                                      color_codes):
-                            raise GIFDecoderError("LZW algorythm failed", image=len(self._images)+1)
-                    # use the Python method
-                    else:
-                        try:
-                            color_codes = []
-                            self._LZWalgorythm(color_codes)
-                        except GIFDecoderError:
-                            raise GIFDecoderError("LZW algorythm failed", image=len(self._images)+1) 
-                    if self._has_local_table:
-                        color_table = self._local_color_table
-                    elif self._has_global_table:
-                        color_table = self._global_color_table
-                    else:
-                        raise GIFDecoderError("No color table", image=len(self._images)+1)
-                    if self._lib:
-                        array = (c_ubyte * (3 * color_codes_len))()
-                        self._lib.fill_colors(color_table, c_uint(color_codes_len), color_codes, array)
-                    else:
-                        array = bytearray(3 * color_codes_len)
-                        for i in range(color_codes_len):
-                            array[3 * i : 3 * i + 3] = color_table[3 * color_codes[i] : 3 * color_codes[i] + 3]                    
-                    surf = pygame.image.frombuffer(array, (self._image_width, self._image_height), "RGB")
-                    if self._has_transparent_color:
-                        surf.set_colorkey(color_table[3 * self._transparent_index:3 * self._transparent_index + 3])
-                    if self._disposal_method == 1:
-                        previous = surf.copy()
-                    elif self._disposal_method == 2:
-                        screen.fill(color_table[self._back_index])
-                        previous = screen.copy()
-                    elif self._disposal_method == 3:
-                        screen.blit(previous, (0, 0))
-                    screen.blit(surf, (self._image_left_pos, self._image_top_pos))          
-                    self._images.append(screen.copy())
-                    self._reset_graphics()
-                                        
-                self._buffer = self._f.read(1)
+            self._crop = pygame.Rect(0, 0, self._screen_width, self._screen_height)
+            if crop is not None:
+                self._crop = self._crop.clip(crop)
+                if not self._crop:
+                    raise GIFDecoderError("Crop rectangle outside the image")
+            self._shift = shrink.bit_length() - 1
+            self._canvas_width = (self._crop.w + shrink - 1) >> self._shift
+            self._canvas_height = (self._crop.h + shrink - 1) >> self._shift
+            images = self._scan_images()
+            self._select_frames(len(images), frames, step)
+            self._check_limits(images)
+            self._delta = delta
+            if compress:
+                self._images = CompressedFrames()
+            elif contiguous:
+                self._images = FrameBuffer(sum(self._keep), (self._canvas_width, self._canvas_height),
+                                           8 * self._format.bpp, self._format.masks)
+                self._images.reset()
+            elif dedupe and not delta:
+                self._hashes = _FrameHashes()
+            if delta:
+                self._dirty = pygame.Rect(0, 0, self._canvas_width, self._canvas_height)
+            if delta or contiguous:
+                self._set_canvas(bytearray(self._format.bpp * self._canvas_width * self._canvas_height),
+                                 self._format.bpp * self._canvas_width)
+            else:
+                # frames are drawn directly into the pixels of their Surface
+                self._set_canvas_surface(self._format.canvas_surface((self._canvas_width,
+                                                                      self._canvas_height)))
+        except:
+            self._end_decoding()
+            raise
+
+    def decode_resume(self, time_budget=None, byte_budget=None):
+        """Go on with the decoding started by decode_start().
+        The images decoded so far can be got with get_images() and the decoding
+        can be resumed calling this again, until it returns **True**. At least an
+        image is decoded at every call, so the decoding always progresses.
+        \param time_budget if you leave **None** the decoding goes on until the end
+        of the file, otherwise it stops after the image during which the given time
+        (in milliseconds) has elapsed.
+        \param byte_budget if you leave **None** the decoding goes on until the end
+        of the file, otherwise it stops after the image during which the given
+        amount of compressed data (in bytes) has been decoded.
+        \return **True** if the decoding is complete, **False** otherwise.
+        """
+        if not self.is_decoding():
+            return True
+        end_time = None if time_budget is None else time.perf_counter() + time_budget / 1000
+        try:
+            while self._frame_count < len(self._keep):
+                data_size = self._decode_next_block()
+                if data_size is None:
+                    break
+                if byte_budget is not None:
+                    byte_budget -= data_size
+                # only after an image, so that every call decodes at least one
+                over_budget = data_size and ((byte_budget is not None and byte_budget <= 0) or
+                                             (end_time is not None and time.perf_counter() >= end_time))
+                if over_budget and self._frame_count < len(self._keep):
+                    return False
             if _debug:
                 print("End of input stream")
+            self._end_decoding()
+            return True
+        except:
+            self._end_decoding()
+            raise
+
+    def is_decoding(self):
+        """Return **True** if a decoding started by decode_start() is not complete."""
+        return self._f is not None and not self._f.closed
+
+    def _decode_next_block(self):
+        """Read and decode the next block of the file.
+        Return the size of the compressed data of the block if it was an image,
+        0 for other blocks and **None** if the decoding is complete."""
+        self._buffer = self._f.read(1)
+        if not self._buffer or self._buffer[0] == _TRAILER:
+            return None
+        if self._buffer[0] == _EXTENSION_INTRODUCER:
+            self._buffer = self._f.read(1)
+            if self._buffer[0] == _GRAPHIC_CONTROL_EXTENSION:
+                if _debug:
+                    print("Graphic control extension")
+                self._read_blocks()
+                self._disposal_method = (self._buffer[0] & 0x1C) >> 2
+                self._user_input = bool(self._buffer[0] & 0x02)
+                self._has_transparent_color = bool(self._buffer[0] & 0x01)
+                self._delay_time = int.from_bytes(self._buffer[1:3], "little")
+                self._transparent_index = self._buffer[3]    
+            elif self._buffer[0] == _COMMENT_EXTENSION:
+                self._read_blocks()
+                if _debug:
+                    print("Comment extension")
+                    print(self._buffer.decode("utf-8"))
+            elif self._buffer[0] == _PLAIN_TEXT_EXTENSION:
+                self._read_blocks()
+                if _debug:
+                    print("Plain text extension")
+                    print(self._buffer.decode("utf-8"))
+            elif self._buffer[0] == _APPLICATION_EXTENSION:
+                self._read_blocks()
+                if _debug:
+                    print("Application extension")
+                    print(self._buffer.decode("utf-8"))
+            else:
+                raise ValueError("Unknown extension")
+        elif self._buffer[0] == _IMAGE_SEPARATOR:
+            keep = self._keep[self._frame_count]
+            self._frame_count += 1
+            if _debug:
+                print("Image n.", self._frame_count, "" if keep else "(skipped)")
+            self._read_image_descriptor()
+            if self._surface_owned:
+                # the canvas is the last returned frame: go on drawing on a copy
+                surf = self._surface
+                self._release_canvas()
+                self._set_canvas_surface(surf.copy())
+            if self._frame_count == 1:
+                self._start_canvas()
+            self._dispose()
+            if self._disposal_method == 3:
+                self._saved_canvas = bytes(self._canvas)
+            self._decode_image()
+            if self._delta:
+                self._add_dirty(self._canvas_rect(self._image_left_pos, self._image_top_pos,
+                                                  self._image_width, self._image_height))
+            if keep and self._delta:
+                if self._kept_canvas is not None:
+                    self._tighten_dirty()
+                else:
+                    self._images = DeltaFrames((self._canvas_width, self._canvas_height), self._format.colorkey)
+                surf = (self._format.make_surface(self._canvas_region(self._dirty), self._dirty.size, False)
+                        if self._dirty else None)
+                self._images.append(surf, self._dirty.topleft)
+                self._delays.append(10 * self._delay_time)
+                self._dirty = pygame.Rect(0, 0, 0, 0)
+                self._kept_canvas = bytes(self._canvas)
+            elif keep and isinstance(self._images, FrameBuffer):
+                frames = self._images
+                frames.palette, frames.colorkey = self._format.palette, self._format.colorkey
+                frames.append(self._canvas)
+                self._delays.append(10 * self._delay_time)
+            elif keep:
+                surf = self._surface
+                frame = self._hashes.get(self._canvas, lambda: surf) if self._hashes else surf
+                self._release_canvas()
+                self._format.prepare(surf)
+                self._images.append(frame)
+                if frame is surf and not isinstance(self._images, CompressedFrames):
+                    self._surface_owned = True
+                else:
+                    # the frame was copied (or was already there): keep drawing on the Surface
+                    self._set_canvas_surface(surf)
+                self._delays.append(10 * self._delay_time)
+            self._last_disposal = self._disposal_method
+            self._last_rect = (self._image_left_pos, self._image_top_pos,
+                               self._image_width, self._image_height)
+            self._reset_graphics()
+            return len(self._buffer)
+        return 0
+
+    def _end_decoding(self):
+        ## INTERNAL FUNCTION
+        if self._f is not None:
+            self._f.close()
+            self._f = None
             if _log:
                 self._log_end()
-        return self._images          
+        self._release_canvas()
+        self._surface = self._saved_canvas = self._kept_canvas = None
+
+    def _set_canvas(self, canvas, pitch):
+        ## INTERNAL FUNCTION
+        self._canvas, self._pitch = canvas, pitch
+        if self._lib:
+            self._canvas_ptr = self._lib.canvas(canvas)
+
+    def _set_canvas_surface(self, surf):
+        """Use the pixels of a Surface as the canvas (the Surface stays locked until
+        _release_canvas() is called)."""
+        self._surface, self._surface_owned = surf, False
+        self._surface_buffer = surf.get_buffer()
+        self._set_canvas(memoryview(self._surface_buffer), surf.get_pitch())
+
+    def _release_canvas(self):
+        ## INTERNAL FUNCTION
+        self._canvas_ptr = None
+        if isinstance(self._canvas, memoryview):
+            self._canvas.release()
+        self._canvas = self._surface_buffer = None
             
     def debug_blocks(self, fname):
         """Print a summary of the blocks included in a GIF file.
@@ -974,14 +1897,32 @@ class GIFDecoder:
             
             self._logf.write("Images:  " + str(len(self._images)) + "\n")
             self._logf.write("Time:    " + "{:.3f}".format(time_diff / 1000000000) + "\n")
-            self._logf.write("Average: " + "{:.3f}".format(time_diff / (1000000000 * len(self._images))) + "\n")
+            self._logf.write("Average: " + "{:.3f}".format(time_diff / (1000000000 * max(len(self._images), 1))) + "\n")
             self._logf.write(_LOG_STRING)
             self._logf.close()
             
     
     def get_images(self):
-        """Return the list of images of the last decoded GIF file."""
+        """Return the list of images of the last decoded GIF file (a DeltaFrames
+        or CompressedFrames object if it was decoded in delta or compressed mode)."""
         return self._images
+
+    def get_delays(self):
+        """Return a list with the delay (in milliseconds) of every frame of the
+        last decoded GIF file, as written in the file (0 if not given)."""
+        return self._delays
+
+    def get_dedupe_ratio(self):
+        """Return the number of frames of the last decoded GIF file divided by the
+        number of different Surface objects which hold them (1.0 if it wasn't
+        decoded with the _dedupe_ option)."""
+        return _dedupe_ratio(self._images)
+
+    def get_memory(self):
+        """Return the memory (in bytes) taken by the frames of the last decoded GIF
+        file, counting only once the memory shared by more frames (see the module
+        get_memory() function)."""
+        return get_memory(self)
     
     def save_images(self, prefix=None, form="04d", ext=".png"):
         """Save the single frames of the last decoded GIF file into separate files.
@@ -1026,8 +1967,10 @@ class SheetSlicer:
         """The constructor."""
         self._fname = ""
         self._images = []
+        self._hashes = None
+        _holders.add(self)
 
-    def slice(self, sheet, h, v, orig_w=None, orig_h=None):
+    def slice(self, sheet, h, v, orig_w=None, orig_h=None, dedupe=False, target=None, prepare=False):
         """Split a rectangular image into subframes and return them as a list
         of pygame Surface.
         You can get the list of images also with the get_images() method.
@@ -1041,8 +1984,27 @@ class SheetSlicer:
         _orig_h_ // _v_ (where // stands for the integer division).
         In some cases you can get better results setting a different _orig_w_
         and _orig_h_ than the Surface dimensions.
+        \param dedupe if **True** identical frames share the same Surface object
+        (see get_dedupe_ratio()).
+        \param target if you leave **None** the frames have the pixel format of the
+        sheet, otherwise you can give a Surface (as the display Surface) and get
+        them with its format, so they are blitted to it without any conversion.
+        Give a Surface with per pixel alpha (as one returned by convert_alpha())
+        to keep the transparent parts of the sheet.
+        \param prepare if **True** the frames are converted for the fastest blitting
+        to the display with prepare_frames() (this overrides _target_).
+        \note if the module anim_cache is enabled and _sheet_ is a file already
+        sliced with the same parameters the frames are taken from it (see AnimCache).
         """        
+        params, fname = (h, v, orig_w, orig_h, dedupe,
+                         None if target is None else (target.get_bitsize(), target.get_masks())), None
         if isinstance(sheet, str):
+            item = anim_cache._lookup("sheet", sheet, params)
+            if item:
+                self._fname = sheet
+                self._images = prepare_frames(item[0]) if prepare else item[0]
+                return self._images
+            fname = sheet
             try:
                 temp = pygame.image.load(sheet).convert_alpha()
             except:
@@ -1056,14 +2018,25 @@ class SheetSlicer:
         if orig_h == None:
             orig_h = sheet.get_height()
         self._images = []
+        self._hashes = _FrameHashes() if dedupe else None
         width, height = orig_w // h, orig_h // v
-        surf = pygame.Surface((width, height), flags=sheet.get_flags(), depth=sheet.get_bitsize())
+        if target is None:
+            surf = pygame.Surface((width, height), flags=sheet.get_flags(), depth=sheet.get_bitsize())
+        else:
+            surf = pygame.Surface((width, height), target.get_flags() & pygame.SRCALPHA, target)
         for i in range(v):
             for j in range(h):
                 surf.fill((0, 0, 0, 0) if surf.get_bitsize() == 32 else (0, 0, 0))
                 rect = pygame.Rect(width * j, height * i, width, height)
                 surf.blit(sheet, (0, 0), area=rect)
-                self._images.append(surf.copy())
+                if self._hashes:
+                    self._images.append(self._hashes.get(pygame.image.tobytes(surf, "RGBA"), surf.copy))
+                else:
+                    self._images.append(surf.copy())
+        if fname:
+            self._images = anim_cache._store("sheet", fname, params, self._images)
+        if prepare:
+            self._images = prepare_frames(self._images)
         return self._images
     
     def get_images(self, first=0, last=None):
@@ -1074,7 +2047,20 @@ class SheetSlicer:
         to the last one."""
         if last == None:
             last = len(self._images)
-        return self._images[first:last]
+        images = self._images if isinstance(self._images, list) else list(self._images)
+        return images[first:last]
+
+    def get_dedupe_ratio(self):
+        """Return the number of frames of the last sliced Surface divided by the
+        number of different Surface objects which hold them (1.0 if it wasn't
+        sliced with the _dedupe_ option)."""
+        return _dedupe_ratio(self._images)
+
+    def get_memory(self):
+        """Return the memory (in bytes) taken by the frames of the last sliced
+        Surface, counting only once the memory shared by more frames (see the module
+        get_memory() function)."""
+        return get_memory(self)
     
     def save_images(self, first=0, last=None, prefix=None, form="04d", ext=".png"):
         """Save the single frames of the last sliced pygame Surface into separate files.
@@ -1111,6 +2097,1258 @@ class SheetSlicer:
             raise ValueError("Empty image list")
 
 
+#######################################################################
+####
+####           P r e p a r e F r a m e s
+####
+#######################################################################
+
+
+# the colorkey given to frames with per pixel alpha which are fully transparent or opaque
+_PREPARE_KEY = (255, 0, 255)
+
+
+def prepare_frames(images):
+    """Return a list with the frames converted for the fastest blitting to the
+    display.
+    Every frame is analysed once, looking at its transparent pixels, and
+    - if it has none, it gets the display format without colorkey and alpha
+    (8 bit frames keep their format, losing only the colorkey);
+    - if its pixels are all fully transparent or fully opaque, it gets the display
+    format and a colorkey (its own, or (255, 0, 255) for frames with per pixel
+    alpha) with the RLEACCEL flag;
+    - otherwise it gets per pixel alpha (as with convert_alpha()) with the RLEACCEL
+    flag.
+    The RLE encoding is done here, so RLE frames are blitted many times faster
+    from the first time, skipping their transparent pixels. Surfaces which are
+    more times in the list are prepared once, and remain shared.
+    \param images a list of Surface. A FrameStore object is returned as it is,
+    because its Surfaces are rebuilt or changed while it is used.
+    \note the display mode must be set. Getting or changing the pixels of RLE
+    frames (get_at(), drawing on them) is slow, so use this for frames which are
+    only blitted.
+    """
+    if isinstance(images, FrameStore):
+        return images
+    display = pygame.display.get_surface()
+    if display is None:
+        raise pygame.error("No video mode has been set")
+    # blitting a RLEACCEL Surface encodes it
+    scratch = pygame.Surface((1, 1), 0, display)
+    prepared = {}
+    for surf in images:
+        if id(surf) not in prepared:
+            prepared[id(surf)] = _prepare_frame(surf, display, scratch)
+    return [prepared[id(surf)] for surf in images]
+
+
+def _prepare_frame(surf, display, scratch):
+    ## INTERNAL FUNCTION
+    size = surf.get_width() * surf.get_height()
+    key, alpha = surf.get_colorkey(), surf.get_alpha()
+    if surf.get_masks()[3]:
+        opaque = pygame.mask.from_surface(surf, 254).count()
+        if opaque == size:
+            new = surf.convert()
+        else:
+            new = None
+            if pygame.mask.from_surface(surf, 0).count() == opaque:
+                new = pygame.Surface(surf.get_size(), 0, display)
+                new.fill(_PREPARE_KEY)
+                new.blit(surf, (0, 0))
+                new.set_colorkey(_PREPARE_KEY)
+                # opaque pixels which have (or are converted to) the colorkey color
+                if pygame.mask.from_surface(new).count() != opaque:
+                    new = None
+            if new is None:
+                new = surf.convert_alpha()
+            else:
+                key = _PREPARE_KEY
+    else:
+        if key is not None and pygame.mask.from_surface(surf).count() == size:
+            key = None
+        if key is None and surf.get_bitsize() == 8:
+            # blitting them reads 1/4 of the memory, which makes up for the palette
+            new = surf.copy()
+        else:
+            new = surf.convert()
+        new.set_colorkey(None)
+    if key is not None:
+        new.set_colorkey(key, pygame.RLEACCEL)
+    if new.get_masks()[3]:
+        new.set_alpha(255 if alpha is None else alpha, pygame.RLEACCEL)
+    elif alpha is not None and alpha != 255:
+        new.set_alpha(alpha, pygame.RLEACCEL)
+    scratch.blit(new, (0, 0))
+    return new
+
+
+#######################################################################
+####
+####           F r a m e S t o r e
+####
+#######################################################################
+
+
+class FrameStore:
+    """Base class for containers of animation frames which don't keep every
+    frame as a separate Surface.
+    They can be used as a read only list of pygame Surface (they support len(),
+    indexing and iteration) and can be given to the AnimSprite.set_images()
+    method instead of a list. Subclasses must implement __len__() and
+    __getitem__().
+    """
+    def __len__(self):
+        raise NotImplementedError
+
+    def __getitem__(self, index):
+        raise NotImplementedError
+
+    def copy(self):
+        """Return a container with the same frames, which shares the stored data
+        with this one but has its own working Surfaces, so both can be shown at
+        the same time at different frames. Subclasses should implement this
+        (the base class returns the object itself)."""
+        return self
+
+    def _nbytes(self):
+        ## INTERNAL FUNCTION
+        blocks = {}
+        self._add_blocks(blocks)
+        return sum(blocks.values())
+
+    def _add_blocks(self, blocks):
+        """Add to the dict _blocks_ the memory blocks which hold the frames (see
+        _add_memory_blocks()). Subclasses which keep the frames in other ways than
+        Surfaces should implement this (the base class gets all the frames)."""
+        _add_memory_blocks(list(self), blocks)
+
+    def _check_index(self, index):
+        ## INTERNAL FUNCTION
+        if index < 0:
+            index += len(self)
+        if not 0 <= index < len(self):
+            raise IndexError("list index out of range")
+        return index
+
+
+class DeltaFrames(FrameStore):
+    """A container of animation frames which stores, for every frame, only the
+    rectangle changed since the previous one.
+    Frames are rebuilt into a single working Surface, applying the changes in
+    sequence, so the Surface returned by indexing is always the same object and
+    its content changes when you get another frame. Getting the frames in order
+    (as AnimSprite does) is fast, while going back to a previous frame needs to
+    rebuild it from the first one. Use copy() to get another working Surface
+    when the frames are shown in more places at once.
+    You usually get this object from GIFDecoder.decode() with the _delta_ option.
+    """
+    def __init__(self, size, colorkey=None):
+        """The constructor.
+        \param size the size of the frames.
+        \param colorkey if not **None**, the colorkey of the frames. The Surfaces
+        given to append() must not have it, because they must overwrite the
+        frame when they are applied.
+        \note Surfaces with per pixel alpha given to append() lose the SRCALPHA
+        flag for the same reason (their alpha values are copied into the frame).
+        """
+        self._size = tuple(size)
+        self._colorkey = colorkey
+        self._deltas = []
+        self._canvas = None
+        self._current = -1
+
+    def append(self, surf, pos):
+        """Add a frame to the container.
+        \param surf a Surface with the part of the frame changed since the previous
+        one (it must be the whole frame for the first frame). It can be **None** if
+        the frame is equal to the previous one.
+        \param pos the position (a duple x, y) of _surf_ into the frame.
+        """
+        if self._canvas is None and surf is not None:
+            self._make_canvas(surf)
+        if surf is not None and surf.get_flags() & pygame.SRCALPHA:
+            surf.set_alpha(None)
+        self._deltas.append((surf, tuple(pos)))
+
+    def copy(self):
+        new = DeltaFrames(self._size, self._colorkey)
+        new._deltas = list(self._deltas)
+        if self._canvas is not None:
+            new._make_canvas(self._canvas)
+        return new
+
+    def _make_canvas(self, surf):
+        ## INTERNAL FUNCTION
+        flags = pygame.SRCALPHA if surf.get_masks()[3] else 0
+        self._canvas = pygame.Surface(self._size, flags, surf)
+        if self._colorkey is not None:
+            self._canvas.set_colorkey(self._colorkey)
+
+    def _add_blocks(self, blocks):
+        ## INTERNAL FUNCTION
+        _add_memory_blocks([surf for surf, pos in self._deltas if surf is not None] +
+                           ([self._canvas] if self._canvas else []), blocks)
+
+    def __len__(self):
+        return len(self._deltas)
+
+    def __getitem__(self, index):
+        index = self._check_index(index)
+        if index < self._current:
+            self._current = -1
+        for surf, pos in self._deltas[self._current + 1:index + 1]:
+            if surf is not None:
+                if surf.get_bitsize() == 8:
+                    # the palette can grow from a frame to the next
+                    self._canvas.set_palette(surf.get_palette())
+                self._canvas.blit(surf, pos)
+        self._current = index
+        return self._canvas
+
+
+class CompressedFrames(FrameStore):
+    """A container of animation frames which keeps them compressed with zlib and
+    expands them only when they are requested.
+    Frames are expanded into two working Surfaces used in turn, so getting a frame
+    doesn't change the one got before it (the current image of an AnimSprite stays
+    valid while the next one is prepared), and only two uncompressed frames are in
+    memory at once. Getting again one of these two frames costs nothing. The
+    object must not be shared by more than one reader (as two AnimSprite, which
+    make their own copy): use copy() to get other working Surfaces.
+    All the frames must have the same size and pixel format; the colorkey and
+    the alpha of the frames are taken from the first one. 8 bit frames (as the ones
+    decoded in "P" mode) take less memory and are expanded faster.
+    You can get this object from GIFDecoder.decode() with the _compress_ option
+    or build it from a list of Surface.
+    """
+    def __init__(self, images=(), level=1):
+        """The constructor.
+        \param images an iterable of Surface objects to append().
+        \param level the zlib compression level, from 1 (fastest) to 9 (smallest).
+        """
+        self._level = level
+        self._frames = []
+        self._surfaces = [None, None]
+        self._indexes = [-1, -1]
+        self._last = 0
+        for surf in images:
+            self.append(surf)
+
+    def append(self, surf):
+        """Compress a Surface and add it as the last frame."""
+        first = self._surfaces[0]
+        if first is None:
+            self._surfaces = [surf.copy(), surf.copy()]
+        elif (surf.get_size() != first.get_size() or surf.get_bitsize() != first.get_bitsize()
+              or surf.get_masks() != first.get_masks() or surf.get_pitch() != first.get_pitch()):
+            raise ValueError("All the frames must have the same size and pixel format")
+        palette = surf.get_palette() if surf.get_bitsize() == 8 else None
+        self._frames.append((zlib.compress(surf.get_buffer().raw, self._level), palette))
+
+    def copy(self):
+        new = CompressedFrames(level=self._level)
+        new._frames = list(self._frames)
+        if self._surfaces[0] is not None:
+            new._surfaces = [surf.copy() for surf in self._surfaces]
+        return new
+
+    def _add_blocks(self, blocks):
+        ## INTERNAL FUNCTION
+        # copies share the compressed data
+        for data, palette in self._frames:
+            blocks[id(data)] = len(data)
+        if self._surfaces[0]:
+            _add_memory_blocks(self._surfaces, blocks)
+
+    def __len__(self):
+        return len(self._frames)
+
+    def __getitem__(self, index):
+        index = self._check_index(index)
+        if index in self._indexes:
+            self._last = self._indexes.index(index)
+        else:
+            # overwrite the frame got before the last one
+            self._last ^= 1
+            surf = self._surfaces[self._last]
+            data, palette = self._frames[index]
+            surf.get_buffer().write(zlib.decompress(data), 0)
+            if palette:
+                surf.set_palette(palette)
+            self._indexes[self._last] = index
+        return self._surfaces[self._last]
+
+
+class FrameBuffer(FrameStore):
+    """A container of animation frames which keeps all their pixels in a single
+    contiguous buffer, with shape (frames, height, width, bytes per pixel) and no
+    padding between rows and frames.
+    The buffer can be got with get_view() (and on Python 3.12+ the object itself
+    supports the buffer protocol), so for example numpy.asarray(frames.get_view())
+    is an array of all the frames which doesn't copy them. Frames are returned by
+    indexing as Surfaces which use the buffer memory (they are made the first time
+    a frame is requested; 16 bit frames are copied, because pygame can't wrap them).
+    You usually get this object from GIFDecoder.decode() with the _contiguous_
+    option.
+    """
+    def __init__(self, count, size, bitsize=24, masks=(0xFF, 0xFF00, 0xFF0000, 0), palette=None,
+                 colorkey=None):
+        """The constructor. All the pixels are initialized to 0.
+        \param count the number of frames.
+        \param size the size of the frames.
+        \param bitsize, masks the pixel format (the default is RGB, one byte per channel).
+        \param palette the palette of 8 bit frames.
+        \param colorkey if not **None**, the colorkey of the frames.
+        """
+        ## The shape of the buffer.
+        self.shape = (count, size[1], size[0], bitsize // 8)
+        ## The palette of the frames (8 bit frames only).
+        self.palette = palette
+        ## The colorkey of the frames.
+        self.colorkey = colorkey
+        self._bitsize = bitsize
+        self._masks = tuple(masks)
+        self._data = bytearray(count * size[0] * size[1] * (bitsize // 8))
+        self._surfaces = [None] * count
+        self._count = count
+
+    def append(self, pixels):
+        """Copy the pixels of a frame (packed rows with the format of the buffer)
+        into the first frame not yet appended (see reset()).
+        \param pixels a bytes-like object with the size of a frame.
+        """
+        if self._count == self.shape[0]:
+            raise IndexError("FrameBuffer is full")
+        self._frame_view(self._count)[:] = pixels
+        self._surfaces[self._count] = None
+        self._count += 1
+
+    def reset(self):
+        """Empty the container, so that frames can be added with append() (the
+        buffer is kept, and its content is overwritten by the new frames). A new
+        object already holds all its frames, filled with 0."""
+        self._count = 0
+        self._surfaces = [None] * self.shape[0]
+
+    def get_view(self):
+        """Return a memoryview of the buffer, with the shape of the object."""
+        return memoryview(self._data).cast("B", self.shape)
+
+    def __buffer__(self, flags):
+        return self.get_view()
+
+    def copy(self):
+        new = FrameBuffer(0, (self.shape[2], self.shape[1]), self._bitsize, self._masks,
+                          self.palette, self.colorkey)
+        new.shape, new._data, new._count = self.shape, self._data, self._count
+        new._surfaces = [None] * self.shape[0]
+        return new
+
+    def _add_blocks(self, blocks):
+        ## INTERNAL FUNCTION
+        # Surfaces made by indexing use the buffer memory
+        key, nbytes = _buffer_block(self._data)
+        blocks[key] = nbytes
+
+    def _frame_view(self, index):
+        ## INTERNAL FUNCTION
+        size = len(self._data) // self.shape[0]
+        return memoryview(self._data)[index * size:(index + 1) * size]
+
+    def __len__(self):
+        return self._count
+
+    def __getitem__(self, index):
+        index = self._check_index(index)
+        surf = self._surfaces[index]
+        if surf is None:
+            surf = _wrap_pixels(self._frame_view(index), (self.shape[2], self.shape[1]),
+                                self._bitsize, self._masks)
+            if self.palette:
+                surf.set_palette(self.palette)
+            if self.colorkey is not None:
+                surf.set_colorkey(self.colorkey)
+            self._surfaces[index] = surf
+        return surf
+
+
+#######################################################################
+####
+####           F r a m e A t l a s
+####
+#######################################################################
+
+
+class FrameAtlas:
+    """An object which packs the frames of many animations into a few large
+    Surfaces (the pages), so their pixels are close in memory and every frame
+    doesn't need its own Surface.
+    Give the frames of every animation (decoded GIF files, sliced sheets) to the
+    add() method, which returns an AtlasFrames object to use instead of them. The
+    frames are trimmed of their transparent borders and placed with the skyline
+    algorithm (every frame goes in the lowest place where it fits, filling the
+    page from top to bottom). Pages are 32 bit Surfaces with per pixel alpha (in
+    the display format, if the display mode is set).
+    """
+    def __init__(self, page_size=(1024, 1024), trim=True):
+        """The constructor.
+        \param page_size the size of the pages (frames larger than it get a page
+        of their own size).
+        \param trim if **True** the transparent borders of the frames are not
+        stored (see AtlasFrames.get_offset()).
+        """
+        self._page_size = tuple(page_size)
+        self._trim = trim
+        self._pages = []
+        # for every page the skyline: a list of segments [x, y, width] which cover the width
+        self._skylines = []
+        _holders.add(self)
+
+    def add(self, images):
+        """Pack a sequence of frames into the pages.
+        \param images a list of Surface or a FrameStore object. The same Surface
+        which appears more times in a list is stored once.
+        \return an AtlasFrames object with the frames.
+        """
+        # the Surfaces of a FrameStore can change while iterating, so the frames are copied
+        shared = not isinstance(images, FrameStore)
+        frames, placed, places = [], [], {}
+        for surf in images:
+            if shared and id(surf) in places:
+                frames.append(places[id(surf)])
+                continue
+            rect = surf.get_bounding_rect() if self._trim else surf.get_rect()
+            frame = None
+            if rect.width and rect.height:
+                # [source Surface, area of the frame into it, offset into the frame]
+                frame = [surf, rect, rect.topleft] if shared else \
+                        [surf.subsurface(rect).copy(), pygame.Rect((0, 0), rect.size), rect.topleft]
+                placed.append(frame)
+            if shared:
+                places[id(surf)] = frame
+            frames.append(frame)
+        # placing the tallest frames first wastes less space
+        placed.sort(key=lambda frame: frame[1].size[::-1], reverse=True)
+        for frame in placed:
+            surf, rect, offset = frame
+            page, x, y = self._place(rect.size)
+            if surf.get_masks()[3]:
+                # an exact copy (the page is transparent black)
+                self._pages[page].blit(surf, (x, y), rect, pygame.BLEND_RGBA_MAX)
+            else:
+                self._pages[page].blit(surf, (x, y), rect)
+            frame[:] = [page, (x, y) + rect.size, offset]
+        return AtlasFrames(self._pages, [tuple(frame) if frame else None for frame in frames])
+
+    def get_pages(self):
+        """Return the list of the pages (Surfaces) of the atlas."""
+        return list(self._pages)
+
+    def _place(self, size):
+        ## INTERNAL FUNCTION
+        for page, skyline in enumerate(self._skylines):
+            place = self._find(skyline, self._pages[page].get_size(), size)
+            if place:
+                x, y, i = place
+                self._raise(skyline, i, x, y + size[1], size[0])
+                return page, x, y
+        page_size = (max(self._page_size[0], size[0]), max(self._page_size[1], size[1]))
+        page = pygame.Surface(page_size, pygame.SRCALPHA, 32)
+        if pygame.display.get_surface():
+            page = page.convert_alpha()
+        page.fill((0, 0, 0, 0))
+        self._pages.append(page)
+        self._skylines.append([[0, 0, page_size[0]]])
+        self._raise(self._skylines[-1], 0, 0, size[1], size[0])
+        return len(self._pages) - 1, 0, 0
+
+    @staticmethod
+    def _find(skyline, page_size, size):
+        ## INTERNAL FUNCTION
+        # returns the lowest (then leftmost) place x, y for a rectangle and the index
+        # of the segment where it starts, or None
+        best = None
+        w, h = size
+        for i, (x, y, width) in enumerate(skyline):
+            if x + w > page_size[0]:
+                break
+            top, covered, j = y, 0, i
+            while covered < w:
+                top = max(top, skyline[j][1])
+                covered += skyline[j][2]
+                j += 1
+            if top + h <= page_size[1] and (best is None or top < best[1]):
+                best = (x, top, i)
+        return best
+
+    @staticmethod
+    def _raise(skyline, i, x, y, w):
+        ## INTERNAL FUNCTION
+        # puts the segment [x, y, w] into the skyline starting from the segment i
+        end = x + w
+        j = i
+        while j < len(skyline) and skyline[j][0] + skyline[j][2] <= end:
+            j += 1
+        if j < len(skyline) and skyline[j][0] < end:
+            skyline[j][2] -= end - skyline[j][0]
+            skyline[j][0] = end
+        skyline[i:j] = [[x, y, w]]
+        # merge segments with the same height
+        k = 0
+        while k < len(skyline) - 1:
+            if skyline[k][1] == skyline[k + 1][1]:
+                skyline[k][2] += skyline.pop(k + 1)[2]
+            else:
+                k += 1
+
+
+class AtlasFrames(FrameStore):
+    """A container of animation frames stored into the pages of a FrameAtlas.
+    Indexing returns a subsurface of a page, which uses the page pixels (they are
+    made the first time a frame is requested). If the atlas trims the frames the
+    subsurfaces have only the part of the frames inside their transparent borders,
+    so they can have different sizes: get_offset() gives their position into the
+    whole frame, and AnimSprite uses it to place them (its _rect_ is the one of
+    the trimmed frame).
+    You get this object from FrameAtlas.add().
+    """
+    def __init__(self, pages, frames):
+        ## INTERNAL FUNCTION
+        self._pages = pages
+        # for every frame (page index, rect into the page, offset into the frame), or None
+        # if the frame is fully transparent
+        self._frames = frames
+        self._surfaces = {}
+
+    def get_offset(self, index):
+        """Return the position (a duple x, y) of a trimmed frame into the whole frame."""
+        frame = self._frames[self._check_index(index)]
+        return frame[2] if frame else (0, 0)
+
+    def get_area(self, index):
+        """Return a duple (page, area) with the page Surface which holds a frame
+        and the Rect of the frame into it, so you can draw the frame with
+        surface.blit(page, pos, area) (for a fully transparent frame area has size
+        0)."""
+        frame = self._frames[self._check_index(index)]
+        if frame is None:
+            return self._pages[0] if self._pages else pygame.Surface((0, 0)), pygame.Rect(0, 0, 0, 0)
+        return self._pages[frame[0]], pygame.Rect(frame[1])
+
+    def _add_blocks(self, blocks):
+        ## INTERNAL FUNCTION
+        _add_memory_blocks([self._pages[page] for page in {frame[0] for frame in self._frames if frame}],
+                           blocks)
+
+    def __len__(self):
+        return len(self._frames)
+
+    def __getitem__(self, index):
+        index = self._check_index(index)
+        frame = self._frames[index]
+        surf = self._surfaces.get(frame)
+        if surf is None:
+            if frame is None:
+                surf = pygame.Surface((0, 0), pygame.SRCALPHA, 32)
+            else:
+                surf = self._pages[frame[0]].subsurface(frame[1])
+            self._surfaces[frame] = surf
+        return surf
+
+
+#######################################################################
+####
+####           A n i m C a c h e
+####
+#######################################################################
+
+
+import mmap, struct, tempfile
+from multiprocessing import shared_memory
+try:
+    import fcntl
+except ImportError:
+    fcntl = None
+
+# header of .animcache files: magic, source hash, kind (0 list, 1 DeltaFrames), colorkey kind
+# (0 none, 1 color, 2 palette index), colorkey, width, height, number of frames, number of blocks
+_ANIMCACHE_HEADER = struct.Struct("<8s16sBB4sIIII")
+# a frame: block index (-1 if none), x, y, delay
+_ANIMCACHE_FRAME = struct.Struct("<iiiI")
+# a block of pixels: offset, width, height, format, bitsize, colorkey kind (as in the header),
+# alpha (-1 if none), colorkey, masks, number of palette colors
+_ANIMCACHE_BLOCK = struct.Struct("<QIIBBBh4s4IH")
+_ANIMCACHE_MAGIC = b"ANIMCAC3"
+# pixel formats which pygame can wrap without copying (see pygame.image.frombuffer())
+_BUFFER_FORMATS = (
+    ("P", 8, None),
+    ("RGB", 24, (0xFF, 0xFF00, 0xFF0000, 0)),
+    ("BGR", 24, (0xFF0000, 0xFF00, 0xFF, 0)),
+    ("RGBX", 32, (0xFF, 0xFF00, 0xFF0000, 0)),
+    ("RGBA", 32, (0xFF, 0xFF00, 0xFF0000, 0xFF000000)),
+    ("BGRA", 32, (0xFF0000, 0xFF00, 0xFF, 0xFF000000)),
+    ("ARGB", 32, (0xFF00, 0xFF0000, 0xFF000000, 0xFF)))
+_NO_BUFFER_FORMAT = 255
+
+
+def _frames_nbytes(images):
+    """Return the memory (in bytes) taken by the pixels of a list of Surface,
+    counting only once the Surfaces which appear more times (or share their
+    pixels)."""
+    blocks = {}
+    _add_memory_blocks(images, blocks)
+    return sum(blocks.values())
+
+
+def _buffer_block(pixels):
+    """Return a duple (key, size) for the whole memory block exported by the
+    object which _pixels_ (a buffer or a memoryview of a part of it) belongs to."""
+    owner = pixels.obj if isinstance(pixels, memoryview) else pixels
+    with memoryview(owner) as view:
+        return id(owner), view.nbytes
+
+
+def _file_key(fname):
+    """Return a key which identifies a file and changes when it is modified."""
+    st = os.stat(fname)
+    return (os.path.abspath(fname), st.st_mtime_ns, st.st_size)
+
+
+def _source_hash(fname):
+    """Return the hash of the content of a file (16 bytes)."""
+    with open(fname, "rb") as f:
+        return hashlib.blake2b(f.read(), digest_size=16).digest()
+
+
+def _buffer_format(bitsize, masks):
+    """Return the index in _BUFFER_FORMATS of a pixel format, or _NO_BUFFER_FORMAT
+    if pygame can't wrap it."""
+    for i, (fmt, fmt_bitsize, fmt_masks) in enumerate(_BUFFER_FORMATS):
+        if bitsize == fmt_bitsize and (fmt_masks is None or tuple(masks) == fmt_masks):
+            return i
+    return _NO_BUFFER_FORMAT
+
+
+def _wrap_pixels(pixels, size, bitsize, masks, fmt=None):
+    """Return a Surface which uses the pixels in the buffer _pixels_ (packed rows
+    with no padding) without copying them, if pygame can do it, otherwise a Surface
+    with a copy of them.
+    \param fmt the index in _BUFFER_FORMATS of the format (if you leave **None**
+    it is found from _bitsize_ and _masks_).
+    """
+    if fmt is None:
+        fmt = _buffer_format(bitsize, masks)
+    if fmt != _NO_BUFFER_FORMAT:
+        surf = pygame.image.frombuffer(pixels, size, _BUFFER_FORMATS[fmt][0])
+        _borrowed[surf] = _buffer_block(pixels)
+        return surf
+    w, h = size
+    row = w * (bitsize // 8)
+    surf = pygame.Surface(size, pygame.SRCALPHA if masks[3] else 0, bitsize, masks)
+    buf, pitch = surf.get_buffer(), surf.get_pitch()
+    if pitch == row:
+        buf.write(bytes(pixels), 0)
+    else:
+        for y in range(h):
+            buf.write(bytes(pixels[y * row:(y + 1) * row]), y * pitch)
+    del buf
+    return surf
+
+
+def _colorkey_index(surf, pixels):
+    """Return the palette index which is the colorkey of an 8 bit Surface.
+    get_colorkey() gives only its color, and more palette entries can have it
+    (see _PaletteFormat), so the used ones are checked blitting one of their
+    pixels: if none is transparent the colorkey is one of the unused ones.
+    \param pixels the pixels of the Surface (packed rows).
+    """
+    key = tuple(surf.get_colorkey()[:3])
+    indexes = [i for i, color in enumerate(surf.get_palette()) if tuple(color[:3]) == key]
+    if len(indexes) < 2:
+        return indexes[0] if indexes else surf.map_rgb(key)
+    w = surf.get_width()
+    probe = pygame.Surface((1, 1), pygame.SRCALPHA, 32)
+    unused = []
+    for index in indexes:
+        pos = pixels.find(bytes((index,)))
+        if pos < 0:
+            unused.append(index)
+            continue
+        probe.fill((0, 0, 0, 0))
+        probe.blit(surf, (0, 0), (pos % w, pos // w, 1, 1))
+        if probe.get_at((0, 0)).a == 0:
+            return index
+    return unused[0] if unused else indexes[0]
+
+
+def _pack_animcache(images, source_hash, delays=None):
+    """Return the content of a .animcache file (see save_animcache()) as a list
+    of bytes objects."""
+    if isinstance(images, DeltaFrames):
+        kind, size, colorkey, entries = 1, images._size, images._colorkey, images._deltas
+    elif isinstance(images, FrameStore):
+        raise ValueError("Only lists of Surface and DeltaFrames can be saved")
+    else:
+        entries = [(surf, (0, 0)) for surf in images]
+        kind, size, colorkey = 0, (images[0].get_size() if images else (0, 0)), None
+    delays = delays or [0] * len(entries)
+    indexes, blocks = {}, []
+    for surf, pos in entries:
+        if surf is not None and id(surf) not in indexes:
+            indexes[id(surf)] = len(blocks)
+            blocks.append(surf)
+    offset = (_ANIMCACHE_HEADER.size + len(entries) * _ANIMCACHE_FRAME.size +
+              len(blocks) * _ANIMCACHE_BLOCK.size + 7) & ~7
+    table, data = [], []
+    for surf in blocks:
+        w, h = surf.get_size()
+        bpp, pitch = surf.get_bytesize(), surf.get_pitch()
+        palette = bytes(c for color in surf.get_palette() for c in color[:3]) if bpp == 1 else b""
+        raw = surf.get_buffer().raw
+        pixels = raw if pitch == w * bpp else b"".join(raw[y * pitch:y * pitch + w * bpp] for y in range(h))
+        key, alpha = surf.get_colorkey(), surf.get_alpha()
+        if key is None:
+            key_kind, key = 0, bytes(4)
+        elif bpp == 1:
+            key_kind, key = 2, bytes((_colorkey_index(surf, pixels), 0, 0, 0))
+        else:
+            key_kind, key = 1, bytes(tuple(key))
+        table.append(_ANIMCACHE_BLOCK.pack(offset, w, h, _buffer_format(surf.get_bitsize(), surf.get_masks()),
+                                           surf.get_bitsize(), key_kind, -1 if alpha is None else alpha,
+                                           key, *surf.get_masks(), len(palette) // 3))
+        chunk = palette + b"\0" * (-len(palette) % 8) + pixels
+        chunk += b"\0" * (-len(chunk) % 8)
+        data.append(chunk)
+        offset += len(chunk)
+    if colorkey is None:
+        key_kind, key = 0, bytes(4)
+    elif isinstance(colorkey, int):
+        # a palette index (frames in "P" mode)
+        key_kind, key = 2, bytes((colorkey, 0, 0, 0))
+    else:
+        key_kind, key = 1, bytes(tuple(pygame.Color(colorkey)))
+    header = _ANIMCACHE_HEADER.pack(_ANIMCACHE_MAGIC, source_hash, kind, key_kind, key, size[0], size[1],
+                                    len(entries), len(blocks))
+    frames = [_ANIMCACHE_FRAME.pack(-1 if surf is None else indexes[id(surf)], pos[0], pos[1], delay)
+              for (surf, pos), delay in zip(entries, delays)]
+    head = header + b"".join(frames) + b"".join(table)
+    return [head + b"\0" * (-len(head) % 8)] + data
+
+
+def save_animcache(fname, images, source_hash, delays=None):
+    """Save a list of frames into a .animcache file, which can be loaded back
+    with load_animcache() without any decoding.
+    Frames repeated in the list are saved only once.
+    \param fname the name of the file.
+    \param images a list of Surface or a DeltaFrames object.
+    \param source_hash a bytes object of 16 bytes identifying the source of the
+    frames (load_animcache() can check it to reject stale files).
+    \param delays the list of the frame delays (in milliseconds), if any.
+    """
+    # write to a temporary file, so a reader never sees a partial file
+    temp = fname + ".tmp"
+    with open(temp, "wb") as f:
+        f.writelines(_pack_animcache(images, source_hash, delays))
+    os.replace(temp, fname)
+
+
+def load_animcache(fname, source_hash=None):
+    """Load the frames saved in a .animcache file by save_animcache().
+    The file is memory mapped and the Surfaces use the mapped pixels directly
+    (8, 24 and 32 bit formats), so nothing is decoded or copied: the pages are
+    read from the disk only when they are used, and shared with other processes
+    mapping the same file. The Surfaces can be drawn on (changes are not written
+    to the file).
+    \param fname the name of the file.
+    \param source_hash if not **None**, the file is rejected if it was saved
+    with another source hash.
+    \return a duple (images, delays), where images is a list of Surface or a
+    DeltaFrames object (as it was saved), or **None** if the file doesn't exist or
+    is not valid.
+    """
+    try:
+        with open(fname, "rb") as f:
+            mm = mmap.mmap(f.fileno(), 0, access=mmap.ACCESS_COPY)
+    except (OSError, ValueError):
+        return None
+    return _unpack_animcache(memoryview(mm), source_hash)
+
+
+def _unpack_animcache(mm, source_hash=None):
+    """Build the frames from the content of a .animcache file in the memoryview
+    _mm_, without copying the pixels (see load_animcache())."""
+    try:
+        magic, source, kind, key_kind, key, width, height, nframes, nblocks = \
+            _ANIMCACHE_HEADER.unpack_from(mm, 0)
+        if (magic != _ANIMCACHE_MAGIC or key_kind > 2 or
+            (source_hash is not None and source != source_hash)):
+            return None
+        pos = _ANIMCACHE_HEADER.size
+        frames = [_ANIMCACHE_FRAME.unpack_from(mm, pos + i * _ANIMCACHE_FRAME.size) for i in range(nframes)]
+        pos += nframes * _ANIMCACHE_FRAME.size
+        blocks = []
+        for i in range(nblocks):
+            (offset, w, h, fmt, bitsize, block_key_kind, alpha, block_key,
+             *masks, ncolors) = _ANIMCACHE_BLOCK.unpack_from(mm, pos + i * _ANIMCACHE_BLOCK.size)
+            palette = mm[offset:offset + 3 * ncolors]
+            palette = list(zip(palette[0::3], palette[1::3], palette[2::3]))
+            offset += (3 * ncolors + 7) & ~7
+            row = w * (bitsize // 8)
+            pixels = mm[offset:offset + row * h]
+            if len(pixels) != row * h:
+                return None
+            surf = _wrap_pixels(pixels, (w, h), bitsize, masks, fmt)
+            if palette:
+                surf.set_palette(palette)
+            if block_key_kind == 1:
+                surf.set_colorkey(tuple(block_key))
+            elif block_key_kind == 2:
+                # an int is the pixel value, i.e. the palette index
+                surf.set_colorkey(block_key[0])
+            if alpha >= 0 and not surf.get_flags() & pygame.SRCALPHA:
+                surf.set_alpha(alpha)
+            blocks.append(surf)
+    except (struct.error, ValueError, IndexError):
+        return None
+    delays = [delay for block, x, y, delay in frames]
+    if kind == 1:
+        images = DeltaFrames((width, height), (None, tuple(key), key[0])[key_kind])
+        for block, x, y, delay in frames:
+            images.append(blocks[block] if block >= 0 else None, (x, y))
+    else:
+        images = [blocks[block] for block, x, y, delay in frames]
+    return images, delays
+
+
+class _SharedSegment:
+    """Internal class which handles a named shared memory block with a reference
+    count (the number of open handles in all processes) in its first 4 bytes and
+    a ready flag in the next 4. The block is unlinked when the count falls to 0.
+    On POSIX systems the block is opened, and the count updated, while holding a
+    lock file, which is removed with the block; on Windows the system itself frees
+    the block when the last handle is closed."""
+    _HEADER = struct.Struct("<II")
+
+    def __init__(self, name, data=None):
+        ## INTERNAL FUNCTION
+        # raises FileNotFoundError (attach) or FileExistsError (create)
+        size = self._HEADER.size + sum(len(chunk) for chunk in data) if data else 0
+        self.name = name
+        self._untracked = False
+        self.shm = None
+        with self._lock() as lock:
+            # the last handle can't be closed (and the block unlinked) meanwhile
+            try:
+                self.shm = self._open(name, data is not None, size)
+            except FileNotFoundError:
+                lock.unlink()
+                raise
+            count, ready = self._HEADER.unpack_from(self.shm.buf, 0)
+            self._HEADER.pack_into(self.shm.buf, 0, count + 1, ready)
+        if data:
+            pos = self._HEADER.size
+            for chunk in data:
+                self.shm.buf[pos:pos + len(chunk)] = chunk
+                pos += len(chunk)
+            with self._lock():
+                count, ready = self._HEADER.unpack_from(self.shm.buf, 0)
+                self._HEADER.pack_into(self.shm.buf, 0, count, 1)
+        self.ready = bool(self._HEADER.unpack_from(self.shm.buf, 0)[1])
+
+    def data(self):
+        """Return a read only memoryview of the content of the block."""
+        return self.shm.buf[self._HEADER.size:].toreadonly()
+
+    def close(self):
+        """Close the handle, unlinking the block if it was the last one."""
+        if self.shm is None:
+            return
+        with self._lock() as lock:
+            count, ready = self._HEADER.unpack_from(self.shm.buf, 0)
+            self._HEADER.pack_into(self.shm.buf, 0, count - 1, ready)
+            if count == 1 and os.name != "nt":
+                lock.unlink()
+                if self._untracked:
+                    # unlink() tells the tracker to forget the block
+                    from multiprocessing import resource_tracker
+                    resource_tracker.register(self.shm._name, "shared_memory")
+                try:
+                    self.shm.unlink()
+                except FileNotFoundError:
+                    pass
+        try:
+            self.shm.close()
+        except BufferError:
+            # Surfaces still use the memory: it is unmapped when they are deleted
+            pass
+        self.shm = None
+
+    def _open(self, name, create, size):
+        ## INTERNAL FUNCTION
+        try:
+            return shared_memory.SharedMemory(name, create, size, track=False)
+        except TypeError:
+            # before Python 3.13 every process tracks the block and unlinks it when
+            # it exits, while here the reference count decides it
+            shm = shared_memory.SharedMemory(name, create, size)
+            if os.name != "nt":
+                from multiprocessing import resource_tracker
+                resource_tracker.unregister(shm._name, "shared_memory")
+                self._untracked = True
+            return shm
+
+    def _lock(self):
+        ## INTERNAL FUNCTION
+        return _FileLock(os.path.join(tempfile.gettempdir(), self.name + ".lock"))
+
+
+class _FileLock:
+    """Internal context manager which holds an exclusive lock on a file (it does
+    nothing where fcntl is not available). The file is created if it doesn't
+    exist, and the holder of the lock can remove it with unlink()."""
+    def __init__(self, fname):
+        self._fname = fname
+        self._f = None
+
+    def __enter__(self):
+        if fcntl:
+            while True:
+                self._f = open(self._fname, "a")
+                fcntl.flock(self._f, fcntl.LOCK_EX)
+                # if the file was unlinked while we were waiting, lock the new one
+                try:
+                    if os.path.samestat(os.stat(self._fname), os.fstat(self._f.fileno())):
+                        break
+                except FileNotFoundError:
+                    pass
+                self._f.close()
+        return self
+
+    def unlink(self):
+        """Remove the file (while still holding the lock)."""
+        if self._f:
+            try:
+                os.unlink(self._fname)
+            except FileNotFoundError:
+                pass
+
+    def __exit__(self, *args):
+        if self._f:
+            fcntl.flock(self._f, fcntl.LOCK_UN)
+            self._f.close()
+            self._f = None
+
+
+class SharedFrames(FrameStore):
+    """A container of animation frames kept in a named shared memory block, so
+    many processes can use the same frames without having their own copy.
+    The first process builds the block from a list of Surface (or a DeltaFrames
+    object), the others attach to it by name and wrap its pixels into Surfaces
+    without decoding or copying them. The block is freed when the last
+    SharedFrames object using it (in any process) is closed or deleted.
+    You usually get this object from GIFDecoder.decode() or SheetSlicer.slice()
+    when the module anim_cache has shared memory enabled (see AnimCache.set_shared()).
+    \note the Surfaces use the shared memory directly: you must not draw on them.
+    If a process crashes without closing its objects the block is not freed
+    until the system is restarted.
+    """
+    def __init__(self, name, images=None, delays=None):
+        """The constructor.
+        \param name the name of the shared memory block.
+        \param images if **None** the object attaches to an existing block (it
+        raises FileNotFoundError if there isn't any), otherwise a new block is
+        created with these frames (a list of Surface or a DeltaFrames object) and
+        it raises FileExistsError if the name is already used.
+        \param delays the list of the frame delays (in milliseconds) to store
+        with new frames.
+        """
+        ## The name of the shared memory block.
+        self.name = name
+        self._segment = None
+        data = None if images is None else _pack_animcache(images, bytes(16), delays)
+        self._segment = _SharedSegment(name, data)
+        item = _unpack_animcache(self._segment.data()) if self._segment.ready else None
+        if item is None:
+            self.close()
+            raise ValueError("Shared frames not ready or not valid")
+        self._frames, self._delays = item
+
+    def get_delays(self):
+        """Return the list of the frame delays (in milliseconds)."""
+        return self._delays
+
+    def close(self):
+        """Release the frames. The object can't be used anymore."""
+        self._frames = []
+        if self._segment:
+            self._segment.close()
+            self._segment = None
+
+    def copy(self):
+        return SharedFrames(self.name)
+
+    def _add_blocks(self, blocks):
+        ## INTERNAL FUNCTION
+        if self._segment:
+            key, nbytes = _buffer_block(self._segment.shm.buf)
+            blocks[key] = nbytes
+
+    def __len__(self):
+        return len(self._frames)
+
+    def __getitem__(self, index):
+        return self._frames[self._check_index(index)]
+
+    def __del__(self):
+        self.close()
+
+
+class AnimCache:
+    """A cache of decoded animations, shared by all GIFDecoder and SheetSlicer
+    objects (the module creates one, named anim_cache).
+    When it is enabled, decoding a GIF file (with GIFDecoder.decode()) or slicing
+    a file (with SheetSlicer.slice()) which was already processed with the same
+    parameters returns the cached frames without reading the file. The cache
+    has two levels, which can be enabled separately:
+    + a memory cache (see set_budget()). Files are identified by their path,
+    modification time and size, so a changed file is decoded again. When the
+    memory taken by the cached frames exceeds the budget the least recently used
+    animations are dropped.
+    + a directory of .animcache files (see set_dir() and save_animcache()), which
+    survive the program. They are written after the first decoding and memory
+    mapped by the next runs, and they are ignored (and rewritten) when the
+    content of the source file changes.
+    + shared memory blocks (see set_shared()), which let many processes running
+    at the same time use a single copy of the frames.
+    \note cached Surfaces are shared by all the lists returned for the same
+    animation, so you should not draw on them (DeltaFrames and CompressedFrames
+    objects are returned as copies with their own working Surfaces).
+    """
+    def __init__(self, max_bytes=0, path=None, shared=False):
+        """The constructor.
+        \param max_bytes the memory budget (see set_budget()).
+        \param path the directory of the .animcache files (see set_dir()).
+        \param shared **True** to use shared memory (see set_shared()).
+        """
+        ## The memory budget in bytes.
+        self.max_bytes = max_bytes
+        ## The directory of the .animcache files (**None** if not used).
+        self.path = path
+        ## **True** if the frames are put into shared memory.
+        self.shared = shared
+        ## The number of requests found in the cache.
+        self.hits = 0
+        ## The number of requests not found in the cache.
+        self.misses = 0
+        self._items = OrderedDict()
+        self._bytes = 0
+        self._hashes = {}
+
+    def set_budget(self, max_bytes):
+        """Set the maximum memory (in bytes) taken by the cached frames, dropping
+        the animations which exceed it. 0 (the default) disables the memory cache."""
+        self.max_bytes = max_bytes
+        self._evict()
+
+    def set_dir(self, path):
+        """Set the directory where the decoded animations are saved as .animcache
+        files (it is created if it doesn't exist). **None** (the default) disables
+        them. Frames in compressed or contiguous mode are not saved."""
+        if path is not None:
+            os.makedirs(path, exist_ok=True)
+        self.path = path
+
+    def set_shared(self, shared=True):
+        """Enable or disable shared memory. When it is enabled, decoded frames are
+        returned as SharedFrames objects, kept in a shared memory block named after
+        the file and the decoding parameters: another process asking for the same
+        frames attaches to the block instead of decoding the file. A block lives
+        while any process has a SharedFrames object using it. Frames in compressed
+        or contiguous mode are not shared."""
+        self.shared = shared
+
+    def get_size(self):
+        """Return the memory (in bytes) taken by the cached frames."""
+        return self._bytes
+
+    def clear(self):
+        """Remove all the animations from the memory cache and reset the counters
+        (.animcache files are not deleted)."""
+        self._items.clear()
+        self._hashes.clear()
+        self._bytes = self.hits = self.misses = 0
+
+    def _lookup(self, kind, fname, params):
+        ## INTERNAL FUNCTION
+        if not self.max_bytes and not self.path and not self.shared:
+            return None
+        key = (kind, _file_key(fname), params)
+        item = self._get(key)
+        if item is None and self.shared:
+            try:
+                frames = SharedFrames(self._shared_name(key))
+            except (FileNotFoundError, ValueError):
+                pass
+            else:
+                item = (frames, frames.get_delays())
+                self._put(key, *item)
+        if item is None and self.path:
+            item = load_animcache(self._cache_name(kind, fname, params), self._source_hash(key[1]))
+            if item is not None:
+                item = (self._share(key, *item), item[1])
+                self._put(key, *item)
+        if item is None:
+            self.misses += 1
+        else:
+            self.hits += 1
+        return item
+
+    def _store(self, kind, fname, params, images, extra=None):
+        ## INTERNAL FUNCTION
+        # returns the frames to be used (they are moved to shared memory if enabled)
+        if not self.max_bytes and not self.path and not self.shared:
+            return images
+        key = (kind, _file_key(fname), params)
+        if self.path and isinstance(images, (list, DeltaFrames)):
+            save_animcache(self._cache_name(kind, fname, params), images,
+                           self._source_hash(key[1]), extra)
+        images = self._share(key, images, extra)
+        self._put(key, images, extra)
+        return images
+
+    def _share(self, key, images, delays):
+        ## INTERNAL FUNCTION
+        if not self.shared or not isinstance(images, (list, DeltaFrames)):
+            return images
+        name = self._shared_name(key)
+        try:
+            return SharedFrames(name, images, delays)
+        except FileExistsError:
+            # another process has just made it
+            try:
+                return SharedFrames(name)
+            except (FileNotFoundError, ValueError):
+                return images
+
+    def _shared_name(self, key):
+        ## INTERNAL FUNCTION
+        return "aic" + hashlib.blake2b(repr(key).encode(), digest_size=12).hexdigest()
+
+    def _cache_name(self, kind, fname, params):
+        ## INTERNAL FUNCTION
+        name = repr((kind, os.path.abspath(fname), params)).encode()
+        return os.path.join(self.path, hashlib.blake2b(name, digest_size=16).hexdigest() + ".animcache")
+
+    def _source_hash(self, file_key):
+        ## INTERNAL FUNCTION
+        if file_key not in self._hashes:
+            self._hashes[file_key] = _source_hash(file_key[0])
+        return self._hashes[file_key]
+
+    def _get(self, key):
+        ## INTERNAL FUNCTION
+        item = self._items.get(key) if self.max_bytes else None
+        if item is None:
+            return None
+        self._items.move_to_end(key)
+        images, extra, nbytes = item
+        return (images.copy() if isinstance(images, FrameStore) else list(images)), extra
+
+    def _put(self, key, images, extra=None):
+        ## INTERNAL FUNCTION
+        if not self.max_bytes:
+            return
+        nbytes = _frames_nbytes(images) if isinstance(images, list) else images._nbytes()
+        if nbytes > self.max_bytes:
+            return
+        if key in self._items:
+            self._bytes -= self._items.pop(key)[2]
+        images = images.copy() if isinstance(images, FrameStore) else list(images)
+        self._items[key] = (images, extra, nbytes)
+        self._bytes += nbytes
+        self._evict()
+
+    def _evict(self):
+        ## INTERNAL FUNCTION
+        while self._bytes > self.max_bytes and self._items:
+            self._bytes -= self._items.popitem(last=False)[1][2]
+
+
+## The cache used by GIFDecoder and SheetSlicer (disabled until you give it a
+# budget with set_budget() or a directory with set_dir()).
+anim_cache = AnimCache()
+
+
+#######################################################################
+####
+####           M e m o r y
+####
+#######################################################################
+
+
+import weakref
+
+# the existing objects which hold frames (decoders, slicers, atlases and sprites)
+_holders = weakref.WeakSet()
+# Surfaces made by _wrap_pixels() which use the memory of another object, with
+# its memory block (see _buffer_block())
+_borrowed = weakref.WeakKeyDictionary()
+
+
+def get_memory(*objects):
+    """Return the memory (in bytes) taken by the frames held by some objects.
+    Memory shared by more frames or objects (the same Surface in many lists or
+    sprites, frames merged by the _dedupe_ option, copies of a FrameStore, Surfaces
+    which use the pixels of a FrameBuffer or of a .animcache file) is counted only
+    once, so the result of a call with many objects can be less than the sum of
+    the single ones.
+    \param objects any number of GIFDecoder (the frames of the last decoded file),
+    SheetSlicer, FrameAtlas, AnimSprite, VanishSprite, FlashSprite, pygame Group
+    (its sprites), FrameStore, AnimCache, Surface or lists of them. If you don't
+    give any you get the total of all the existing decoders, slicers, atlases and
+    sprites of this module and of anim_cache.
+    \note memory mapped files and shared memory blocks are counted in full, even
+    if their pages were not read yet or other processes use them too.
+    """
+    if not objects:
+        objects = list(_holders) + [anim_cache]
+    blocks = {}
+    for obj in objects:
+        _add_memory_blocks(obj, blocks)
+    return sum(blocks.values())
+
+
+def _add_memory_blocks(obj, blocks):
+    """Add to the dict _blocks_ the memory blocks which hold the frames of _obj_
+    (see get_memory()). The keys identify the blocks (so a block shared by many
+    objects is added only once) and the values are their sizes."""
+    if isinstance(obj, pygame.Surface):
+        while obj.get_parent() is not None:
+            obj = obj.get_parent()
+        key, nbytes = _borrowed.get(obj) or (id(obj), obj.get_pitch() * obj.get_height())
+        blocks[key] = nbytes
+    elif isinstance(obj, FrameStore):
+        obj._add_blocks(blocks)
+    elif isinstance(obj, (GIFDecoder, SheetSlicer)):
+        _add_memory_blocks(obj._images, blocks)
+    elif isinstance(obj, FrameAtlas):
+        _add_memory_blocks(obj._pages, blocks)
+    elif isinstance(obj, AnimSprite):
+        _add_memory_blocks((obj.images, obj.image), blocks)
+    elif isinstance(obj, (VanishSprite, FlashSprite)):
+        _add_memory_blocks((getattr(obj, "orig_image", None), obj.image), blocks)
+    elif isinstance(obj, AnimCache):
+        _add_memory_blocks([images for images, extra, nbytes in obj._items.values()], blocks)
+    elif isinstance(obj, pygame.sprite.AbstractGroup):
+        _add_memory_blocks(obj.sprites(), blocks)
+    elif isinstance(obj, (list, tuple)):
+        for item in obj:
+            _add_memory_blocks(item, blocks)
+    elif obj is not None:
+        raise TypeError("Cannot get the memory of " + type(obj).__name__)
+
+
 ######################################################################
 ####
 ####           v i e w l i s t
@@ -0,0 +1,35 @@
+##    This file is part of
+##    animimage - Simple animated Sprite extension for pygame
+##    Copyright (C) 2023  Nicola Cassetta
+##    See <https://github.com/ncassetta/Nictk>
+##
+##    This file is free software; you can redistribute it and/or
+##    modify it under the terms of the GNU Library General Public
+##    License as published by the Free Software Foundation; either
+##    version 2 of the License, or (at your option) any later version.
+##
+##    This code is distributed in the hope that it will be useful,
+##    but WITHOUT ANY WARRANTY; without even the implied warranty of
+##    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+##    Library General Public License for more details.
+##
+##    You should have received a copy of the GNU Library General Public
+##    License along with this file; if not, write to the Free
+##    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+# Builds the _gifdecoder extension module, used by GIFDecoder instead of the
+# dynamic library loaded through ctypes. To build it next to animimage.py:
+#     python setup.py build_ext --inplace
+
+from setuptools import setup, Extension
+
+setup(
+    name="animimage",
+    description="Simple animated Sprite extension for pygame",
+    py_modules=["animimage"],
+    install_requires=["pygame"],
+    ext_modules=[Extension("_gifdecoder",
+                           sources=["GIFDecoder/gifdecodermodule.c", "GIFDecoder/GIFDecoder.c",
+                                    "GIFDecoder/myvector.c"],
+                           include_dirs=["GIFDecoder"])],
+)
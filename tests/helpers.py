@@ -0,0 +1,75 @@
+##    This file is part of
+##    animimage - Simple animated Sprite extension for pygame
+##    Copyright (C) 2023  Nicola Cassetta
+##    See <https://github.com/ncassetta/Nictk>
+##
+##    This file is free software; you can redistribute it and/or
+##    modify it under the terms of the GNU Library General Public
+##    License as published by the Free Software Foundation; either
+##    version 2 of the License, or (at your option) any later version.
+##
+##    This code is distributed in the hope that it will be useful,
+##    but WITHOUT ANY WARRANTY; without even the implied warranty of
+##    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+##    Library General Public License for more details.
+##
+##    You should have received a copy of the GNU Library General Public
+##    License along with this file; if not, write to the Free
+##    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+# Functions shared by the tests (this is not a test module).
+
+import os, sys, io, contextlib
+
+os.environ.setdefault("SDL_VIDEODRIVER", "dummy")
+ROOT = os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+sys.path.insert(0, ROOT)
+
+import pygame
+import animimage
+
+FIREWORK = os.path.join(ROOT, "Examples", "firework1.gif")
+SE2017 = os.path.join(ROOT, "GIFDecoder", "se2017aug21t.gif")
+
+
+def new_decoder():
+    """Return a GIFDecoder, hiding the warning printed when the C code is missing."""
+    with contextlib.redirect_stdout(io.StringIO()):
+        return animimage.GIFDecoder()
+
+
+def decode(fname, **params):
+    """Decode a file with a new GIFDecoder."""
+    return new_decoder().decode(fname, **params)
+
+
+# maps alpha values to 1 (transparent) or 0
+_TRANSPARENT = bytes([1] + [0] * 255)
+
+
+def transparent_pixels(surf):
+    """Return a bytes object with 1 for every pixel of a Surface which is not
+    drawn when it is blitted (because of its colorkey or its per pixel alpha)."""
+    probe = pygame.Surface(surf.get_size(), pygame.SRCALPHA, 32)
+    probe.fill((0, 0, 0, 0))
+    probe.blit(surf, (0, 0))
+    return pygame.image.tobytes(probe, "RGBA")[3::4].translate(_TRANSPARENT)
+
+
+def frame_data(images):
+    """Return everything which makes the frames: their size and pixel format, the
+    raw pixels (packed rows), the palette, the colorkey and the pixels it makes
+    transparent (for 8 bit frames the colorkey color doesn't tell which palette
+    index it is). Frames are got in order (DeltaFrames and CompressedFrames reuse
+    their working Surfaces)."""
+    frames = []
+    for i in range(len(images)):
+        surf = images[i]
+        (w, h), bpp, pitch = surf.get_size(), surf.get_bytesize(), surf.get_pitch()
+        raw = surf.get_buffer().raw
+        pixels = b"".join(raw[y * pitch:y * pitch + w * bpp] for y in range(h))
+        palette = [tuple(color) for color in surf.get_palette()] if bpp == 1 else None
+        key = surf.get_colorkey()
+        frames.append(((w, h), surf.get_bitsize(), surf.get_masks(), pixels, palette, key,
+                       surf.get_alpha(), transparent_pixels(surf) if key else None))
+    return frames
@@ -0,0 +1,171 @@
+##    This file is part of
+##    animimage - Simple animated Sprite extension for pygame
+##    Copyright (C) 2023  Nicola Cassetta
+##    See <https://github.com/ncassetta/Nictk>
+##
+##    This file is free software; you can redistribute it and/or
+##    modify it under the terms of the GNU Library General Public
+##    License as published by the Free Software Foundation; either
+##    version 2 of the License, or (at your option) any later version.
+##
+##    This code is distributed in the hope that it will be useful,
+##    but WITHOUT ANY WARRANTY; without even the implied warranty of
+##    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+##    Library General Public License for more details.
+##
+##    You should have received a copy of the GNU Library General Public
+##    License along with this file; if not, write to the Free
+##    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+# Checks the cache of decoded animations (AnimCache) and the stores it uses.
+# Run from the repository root with:
+#     python -m unittest discover tests
+
+import os, sys, tempfile, unittest
+
+sys.path.insert(0, os.path.dirname(os.path.abspath(__file__)))
+from helpers import FIREWORK, decode, frame_data, transparent_pixels
+import pygame
+import animimage
+
+
+class TestMemoryCache(unittest.TestCase):
+    def setUp(self):
+        animimage.anim_cache.clear()
+        animimage.anim_cache.set_budget(256 << 20)
+
+    def tearDown(self):
+        animimage.anim_cache.set_budget(0)
+        animimage.anim_cache.clear()
+
+    def test_hits(self):
+        for params in ({}, {"delta": True}, {"compress": True}, {"mode": "P"}):
+            with self.subTest(**params):
+                expected = frame_data(decode(FIREWORK, **params))
+                hits = animimage.anim_cache.hits
+                images = decode(FIREWORK, **params)
+                self.assertEqual(animimage.anim_cache.hits, hits + 1)
+                self.assertTrue(frame_data(images) == expected, "frames differ")
+
+    def test_independent_hits(self):
+        # every hit has its own working Surfaces (and its own list)
+        for params in ({"delta": True}, {"compress": True}):
+            with self.subTest(**params):
+                decode(FIREWORK, **params)
+                # two hits
+                first, second = decode(FIREWORK, **params), decode(FIREWORK, **params)
+                self.assertIsNot(first, second)
+                surf = first[5]
+                frame = pygame.image.tobytes(surf, "RGB")
+                self.assertIsNot(second[9], surf)
+                self.assertEqual(pygame.image.tobytes(surf, "RGB"), frame)
+        decode(FIREWORK)
+        images = decode(FIREWORK)
+        images.clear()
+        self.assertTrue(decode(FIREWORK))
+
+
+class TestAnimcacheFiles(unittest.TestCase):
+    def setUp(self):
+        self.dir = tempfile.TemporaryDirectory()
+
+    def tearDown(self):
+        animimage.anim_cache.set_dir(None)
+        animimage.anim_cache.clear()
+        self.dir.cleanup()
+
+    def test_round_trip(self):
+        fname = os.path.join(self.dir.name, "frames.animcache")
+        for params in ({}, {"mode": "P"}, {"mode": "RGB565"}, {"delta": True},
+                       {"delta": True, "mode": "P"}, {"delta": True, "mode": "RGB565"}):
+            with self.subTest(**params):
+                images = decode(FIREWORK, **params)
+                delays = list(range(len(images)))
+                animimage.save_animcache(fname, images, bytes(16), delays)
+                loaded, loaded_delays = animimage.load_animcache(fname, bytes(16))
+                self.assertIs(type(loaded), type(images))
+                self.assertEqual(loaded_delays, delays)
+                self.assertTrue(frame_data(loaded) == frame_data(images), "frames differ")
+        self.assertIsNone(animimage.load_animcache(fname, b"\1" * 16))
+
+    def test_duplicated_key_color(self):
+        # all the palette entries are black: the colorkey is the index, not the color
+        fname = os.path.join(self.dir.name, "frames.animcache")
+        images = []
+        for pixels, key in ((b"\0\5", 5), (b"\5\0", 5), (b"\0\1", 5), (b"\0\5", 0)):
+            surf = pygame.Surface((2, 1), 0, 8)
+            surf.set_palette([(0, 0, 0)] * 256)
+            surf.get_buffer().write(pixels, 0)
+            surf.set_colorkey(key)
+            images.append(surf)
+        animimage.save_animcache(fname, images, bytes(16))
+        loaded, delays = animimage.load_animcache(fname)
+        self.assertEqual([transparent_pixels(surf) for surf in loaded],
+                         [b"\0\1", b"\1\0", b"\0\0", b"\1\0"])
+        self.assertTrue(frame_data(loaded) == frame_data(images), "frames differ")
+        shared = animimage.SharedFrames("aictest{}".format(os.getpid()), images)
+        try:
+            self.assertTrue(frame_data(shared) == frame_data(images), "frames differ")
+        finally:
+            shared.close()
+
+    def test_cache_dir(self):
+        animimage.anim_cache.set_dir(self.dir.name)
+        for params in ({"mode": "P"}, {"delta": True, "mode": "P"}):
+            with self.subTest(**params):
+                expected = frame_data(decode(FIREWORK, **params))
+                hits = animimage.anim_cache.hits
+                images = decode(FIREWORK, **params)
+                self.assertEqual(animimage.anim_cache.hits, hits + 1)
+                self.assertTrue(frame_data(images) == expected, "frames differ")
+
+    def test_frames_iterator(self):
+        # the frames parameter is read only once, cache or not
+        animimage.anim_cache.set_dir(self.dir.name)
+        for i in range(2):
+            self.assertEqual(len(decode(FIREWORK, frames=(i for i in (0, 1, 2)))), 3)
+
+
+class TestSharedFrames(unittest.TestCase):
+    def setUp(self):
+        self.name = "aictest{}".format(os.getpid())
+        self.lock = os.path.join(tempfile.gettempdir(), self.name + ".lock")
+
+    def test_round_trip(self):
+        for params in ({}, {"mode": "P"}, {"delta": True, "mode": "P"}):
+            with self.subTest(**params):
+                images = decode(FIREWORK, **params)
+                owner = animimage.SharedFrames(self.name, images, list(range(len(images))))
+                other = animimage.SharedFrames(self.name)
+                self.assertEqual(other.get_delays(), list(range(len(images))))
+                self.assertTrue(frame_data(other) == frame_data(images), "frames differ")
+                with self.assertRaises(FileExistsError):
+                    animimage.SharedFrames(self.name, images)
+                copy = other.copy()
+                self.assertTrue(frame_data(copy) == frame_data(images), "frames differ")
+                for frames in (owner, other, copy):
+                    frames.close()
+                # the block (and its lock file) are removed with the last handle
+                self.assertFalse(os.path.exists(self.lock))
+                with self.assertRaises(FileNotFoundError):
+                    animimage.SharedFrames(self.name)
+                self.assertFalse(os.path.exists(self.lock))
+
+    def test_anim_cache(self):
+        animimage.anim_cache.set_shared(True)
+        try:
+            first = decode(FIREWORK, mode="P")
+            hits = animimage.anim_cache.hits
+            second = decode(FIREWORK, mode="P")
+            self.assertIsInstance(second, animimage.SharedFrames)
+            self.assertEqual(animimage.anim_cache.hits, hits + 1)
+            self.assertTrue(frame_data(second) == frame_data(first), "frames differ")
+            first.close()
+            second.close()
+        finally:
+            animimage.anim_cache.set_shared(False)
+            animimage.anim_cache.clear()
+
+
+if __name__ == "__main__":
+    unittest.main()
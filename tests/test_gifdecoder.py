@@ -0,0 +1,232 @@
+##    This file is part of
+##    animimage - Simple animated Sprite extension for pygame
+##    Copyright (C) 2023  Nicola Cassetta
+##    See <https://github.com/ncassetta/Nictk>
+##
+##    This file is free software; you can redistribute it and/or
+##    modify it under the terms of the GNU Library General Public
+##    License as published by the Free Software Foundation; either
+##    version 2 of the License, or (at your option) any later version.
+##
+##    This code is distributed in the hope that it will be useful,
+##    but WITHOUT ANY WARRANTY; without even the implied warranty of
+##    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+##    Library General Public License for more details.
+##
+##    You should have received a copy of the GNU Library General Public
+##    License along with this file; if not, write to the Free
+##    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+# Checks that every GIFDecoder backend (the _gifdecoder extension, the dynamic
+# library through ctypes, numpy and pure Python) gives the same frames, in all
+# the output formats and storage modes. Run from the repository root with:
+#     python -m unittest discover tests
+
+import os, sys, tempfile, unittest
+from unittest import mock
+
+sys.path.insert(0, os.path.dirname(os.path.abspath(__file__)))
+from helpers import ROOT, FIREWORK, SE2017, new_decoder, frame_data
+import pygame
+import animimage
+
+FILES = [FIREWORK, SE2017]
+
+# (mode, other decode() parameters)
+CASES = [
+    ("RGB", {}),
+    ("P", {}),
+    ("RGB565", {}),
+    ("ARGB", {}),
+    ("XRGB", {}),
+    ("RGB", {"crop": (10, 7, 61, 43)}),
+    ("P", {"shrink": 2}),
+    ("RGB565", {"crop": (3, 5, 40, 31), "shrink": 4}),
+    ("RGB", {"frames": range(2, 40, 3), "step": 2}),
+    ("RGB", {"delta": True}),
+    ("P", {"delta": True}),
+    ("ARGB", {"delta": True}),
+    ("RGB", {"compress": True}),
+    ("P", {"compress": True}),
+    ("RGB", {"contiguous": True}),
+    ("P", {"contiguous": True}),
+    ("RGB", {"dedupe": True}),
+]
+
+
+def _mode(name):
+    """Return the mode parameter of decode() for a case (32 bit formats are
+    given as Surfaces)."""
+    if name == "ARGB":
+        return pygame.Surface((1, 1), pygame.SRCALPHA, 32)
+    if name == "XRGB":
+        return pygame.Surface((1, 1), 0, 32, (0xFF0000, 0xFF00, 0xFF, 0))
+    return name
+
+
+def _native_backends():
+    """Return a dict name: object with the C code interfaces which can be loaded."""
+    backends = {}
+    try:
+        import _gifdecoder
+        backends["extension"] = _gifdecoder
+    except ImportError:
+        pass
+    libpath = os.path.join(ROOT, "GIFDecoder", "GIFDecoder.dll" if os.name == "nt" else "GIFDecoder.so")
+    try:
+        backends["ctypes"] = animimage._CtypesLib(animimage.CDLL(libpath))
+    except OSError:
+        pass
+    return backends
+
+
+class TestBackends(unittest.TestCase):
+    """Every backend must give the frames of the pure Python one."""
+    @classmethod
+    def setUpClass(cls):
+        cls.reference = {}
+        for fname in FILES:
+            cls.reference[fname] = cls.decode_all(fname, None, None)
+
+    @staticmethod
+    def decode_all(fname, lib, numpy):
+        # the caches are keyed by the kind of backend: empty them so every
+        # backend really decodes the file
+        animimage._lut_cache.clear()
+        animimage._codes_cache.clear()
+        animimage._codes_cache_bytes = 0
+        decoder = new_decoder()
+        decoder._lib = lib
+        results = []
+        with mock.patch.object(animimage, "np", numpy):
+            for mode, params in CASES:
+                images = decoder.decode(fname, mode=_mode(mode), **params)
+                results.append(frame_data(images))
+        return results
+
+    def check_backend(self, lib, numpy):
+        for fname in FILES:
+            results = self.decode_all(fname, lib, numpy)
+            for (mode, params), result, expected in zip(CASES, results, self.reference[fname]):
+                with self.subTest(file=os.path.basename(fname), mode=mode, **params):
+                    self.assertEqual(len(result), len(expected))
+                    self.assertTrue(result == expected, "frames differ")
+
+    def test_frames(self):
+        # the reference frames are sane
+        for fname in FILES:
+            full, cropped, shrunk = (self.reference[fname][i] for i in (0, 5, 6))
+            self.assertGreater(len(full), 1)
+            self.assertEqual(cropped[0][0], (61, 43))
+            w, h = full[0][0]
+            self.assertEqual(shrunk[0][0], ((w + 1) // 2, (h + 1) // 2))
+            self.assertEqual(len(self.reference[fname][8]), 7)
+
+    def test_numpy(self):
+        if animimage.np is None:
+            self.skipTest("numpy not installed")
+        self.check_backend(None, animimage.np)
+
+    def test_ctypes(self):
+        lib = _native_backends().get("ctypes")
+        if lib is None:
+            self.skipTest("GIFDecoder dynamic library not built")
+        self.check_backend(lib, None)
+
+    def test_extension(self):
+        lib = _native_backends().get("extension")
+        if lib is None:
+            self.skipTest("_gifdecoder extension not built")
+        self.check_backend(lib, None)
+
+
+class TestResume(unittest.TestCase):
+    def test_budgets(self):
+        # every call of decode_resume() decodes at least an image, whatever the budget
+        expected = frame_data(new_decoder().decode(FIREWORK))
+        for budget in ({"byte_budget": 0}, {"byte_budget": -1}, {"time_budget": 0}):
+            with self.subTest(**budget):
+                decoder = new_decoder()
+                decoder.decode_start(FIREWORK)
+                count = 0
+                while not decoder.decode_resume(**budget):
+                    count += 1
+                    self.assertEqual(len(decoder.get_images()), count)
+                self.assertTrue(frame_data(decoder.get_images()) == expected, "frames differ")
+
+
+class TestLZW(unittest.TestCase):
+    """The pure Python LZW decoder against the C one, on truncated data too."""
+    def blocks(self):
+        # the compressed data of every image of the files
+        blocks = []
+        original = animimage.GIFDecoder._LZWalgorythm
+        def hook(decoder):
+            blocks.append((decoder._lzw_code_size, bytes(decoder._buffer),
+                           decoder._image_width, decoder._image_height))
+            return original(decoder)
+        animimage._codes_cache.clear()
+        animimage._codes_cache_bytes = 0
+        decoder = new_decoder()
+        decoder._lib = None
+        with mock.patch.object(animimage.GIFDecoder, "_LZWalgorythm", hook):
+            for fname in FILES:
+                decoder.decode(fname)
+        return blocks
+
+    def python_lzw(self, code_size, data, width, height):
+        decoder = animimage.GIFDecoder.__new__(animimage.GIFDecoder)
+        decoder._lzw_code_size, decoder._buffer = code_size, data
+        decoder._image_width, decoder._image_height, decoder._frame_count = width, height, 0
+        return list(decoder._LZWalgorythm())
+
+    def test_against_c(self):
+        libs = _native_backends()
+        if not libs:
+            self.skipTest("C code not built")
+        lib = next(iter(libs.values()))
+        for code_size, data, width, height in self.blocks():
+            for size in (len(data), len(data) // 2, len(data) // 5):
+                codes = (animimage.c_uint16 * (width * height))()
+                self.assertTrue(lib.lzw(code_size, data[:size], codes))
+                self.assertTrue(self.python_lzw(code_size, data[:size], width, height) == list(codes),
+                                "codes differ")
+
+    def test_bad_data(self):
+        with self.assertRaises(animimage.GIFDecoderError):
+            # the first code must be CLEAR
+            self.python_lzw(2, b"\x00\x00", 4, 4)
+        for code_size in (0, 9, 12):
+            with self.assertRaises(animimage.GIFDecoderError):
+                self.python_lzw(code_size, b"\x00\x10", 4, 4)
+
+    def test_codes_cache_bytes(self):
+        # the byte counter of the codes cache follows its entries when they are evicted
+        animimage._codes_cache.clear()
+        animimage._codes_cache_bytes = 0
+        decoder = new_decoder()
+        decoder._lib = None
+        with mock.patch.object(animimage, "_CODES_CACHE_BYTES", 40000):
+            for fname in FILES * 2:
+                decoder.decode(fname)
+            self.assertLessEqual(animimage._codes_cache_bytes, 40000)
+        self.assertEqual(animimage._codes_cache_bytes,
+                         sum(nbytes for codes, nbytes in animimage._codes_cache.values()))
+
+    def test_bad_code_size(self):
+        # the GIF maximum is 8 bits, for every backend
+        gif = (b"GIF89a\x02\x00\x02\x00\x80\x00\x00" + bytes(6) + b"\x2c" + bytes(4) +
+               b"\x02\x00\x02\x00\x00\x09\x02\x00\x02\x00\x3b")
+        with tempfile.TemporaryDirectory() as path:
+            fname = os.path.join(path, "bad.gif")
+            with open(fname, "wb") as f:
+                f.write(gif)
+            for lib in [None] + list(_native_backends().values()):
+                decoder = new_decoder()
+                decoder._lib = lib
+                with self.assertRaises(animimage.GIFDecoderError):
+                    decoder.decode(fname)
+
+
+if __name__ == "__main__":
+    unittest.main()